@@ -10,4 +10,52 @@
 
 #define USER_APPLICATION_SECTOR			FLASH_SECTOR_2
 
+/* Board supply range, sets the widest safe flash parallelism:
+ * FLASH_VOLTAGE_RANGE_1 x8 ... FLASH_VOLTAGE_RANGE_3 x32, FLASH_VOLTAGE_RANGE_4 x64 erase (external VPP) */
+#define BL_FLASH_VOLTAGE_RANGE			FLASH_VOLTAGE_RANGE_3
+/* Blank check every sector before its erase, and skip the ones already all 0xFF */
+#define BL_SKIP_BLANK_SECTORS			1
+
+/* Host link baud rate at reset, and the fallback when a switch fails */
+#define BL_DEFAULT_BAUD_RATE			115200
+/* Time allowed for the host probe after a baud rate switch */
+#define BL_BAUD_PROBE_TIMEOUT_MS		500
+
+/* Clock profile the bootloader runs from, entered at boot, see clockServices.h */
+#define BL_CLOCK_PROFILE				BL_CLOCK_PROFILE_HSI_PLL_84MHZ
+
+/* Packet and range CRCs on the CRC unit (1) or on the table driven kernels (0) */
+#define BL_CRC_USE_HARDWARE				1
+
+/* Status LED blink half period while waiting for the host */
+#define BL_LED_BLINK_PERIOD_MS			500
+/* Sleep until the next interrupt when no frame is waiting (0 to busy poll) */
+#define BL_SLEEP_WHEN_IDLE				1
+
+/* Optional commands, set to 0 to strip them and their handlers from small builds */
+#define BL_ENABLE_GO_TO_ADDR			1
+#define BL_ENABLE_MEM_READ				1
+#define BL_ENABLE_PIPELINED_WRITE		1
+#define BL_ENABLE_BAUD_SWITCH			1
+#define BL_ENABLE_COMPRESSED_WRITE		1
+#define BL_ENABLE_DELTA_UPDATE			1
+#define BL_ENABLE_BLOCK_CRC				1
+#define BL_ENABLE_RANGE_CRC				1
+/* RLE / LZ4 encoded streaming reads, needs BL_ENABLE_MEM_READ */
+#define BL_ENABLE_COMPRESSED_READ		1
+/* Pattern fill of an erased application range, CBL_MEM_FILL_CMD */
+#define BL_ENABLE_MEM_FILL				1
+/* On device copy into the application, CBL_MEM_COPY_CMD */
+#define BL_ENABLE_MEM_COPY				1
+/* Write frames made of several extents, CBL_MEM_WRITE_SPARSE_CMD */
+#define BL_ENABLE_SPARSE_WRITE			1
+/* Erase of a sector mask or an address range with progress, CBL_ERASE_RANGE_CMD */
+#define BL_ENABLE_ERASE_RANGE			1
+/* Interrupt driven erase, CBL_ERASE_START_CMD and CBL_ERASE_STATUS_CMD */
+#define BL_ENABLE_BACKGROUND_ERASE		1
+/* Per command counters and DWT cycle timings, read back by CBL_GET_STATS_CMD */
+#define BL_ENABLE_COMMAND_STATS			1
+/* On target timing of every CRC kernel, CBL_CRC_BENCHMARK_CMD. Costs 7 KB of RAM tables */
+#define BL_ENABLE_CRC_BENCHMARK			0
+
 #endif /* INC_BOOTLOADER_BOOTLOADER_CFG_H_ */
@@ -19,6 +19,11 @@
 #include "Bootloader_Cfg.h"
 #include "flashServices/flashServices.h"
 #include "helperFunctions/helperFunctions.h"
+#include "hostLink/hostLink.h"
+#include "clockServices/clockServices.h"
+#include "compression/compression.h"
+#include "crcServices/crcServices.h"
+#include "writeWindow/writeWindow.h"
 /* --------------- Section: Macro Declarations --------------- */
 
 /* !< Bootloader Supported Commands */
@@ -40,6 +45,44 @@
 #define CBL_OTP_READ_CMD            0x20
 /* Change Read Out Protection Level */
 #define CBL_CHANGE_ROP_Level_CMD    0x21
+/* Negotiate the pipelined write window (v2 frames only) */
+#define CBL_WINDOW_CFG_CMD          0x23
+/* Sequence numbered, pipelined memory write (v2 frames only) */
+#define CBL_MEM_WRITE_SEQ_CMD       0x24
+/* Switch the host link baud rate */
+#define CBL_SET_BAUD_CMD            0x25
+/* Read the counters and timings of a command */
+#define CBL_GET_STATS_CMD           0x26
+/* Memory write of a raw, RLE or LZ4 encoded block (v2 frames only) */
+#define CBL_MEM_WRITE_COMPRESSED_CMD 0x27
+/* Delta update: start, patch instructions and commit (v2 frames only) */
+#define CBL_DELTA_BEGIN_CMD         0x28
+#define CBL_DELTA_PATCH_CMD         0x29
+#define CBL_DELTA_COMMIT_CMD        0x2A
+/* One CRC per fixed size block of a memory range */
+#define CBL_BLOCK_CRC_TABLE_CMD     0x2B
+/* One CRC over a whole memory range */
+#define CBL_RANGE_CRC_CMD           0x2C
+/* Cycles taken by every CRC kernel over a memory range */
+#define CBL_CRC_BENCHMARK_CMD       0x2D
+/* Memory read of any length, streamed in checksummed chunks */
+#define CBL_MEM_READ_STREAM_CMD     0x2E
+/* Flash range programmed with a repeated 32-bit pattern */
+#define CBL_MEM_FILL_CMD            0x2F
+/* Flash or SRAM range copied into the flash on device */
+#define CBL_MEM_COPY_CMD            0x30
+/* Memory write of several extents, the gaps between them are skipped (v2 frames only) */
+#define CBL_MEM_WRITE_SPARSE_CMD    0x31
+/* Erase of the sectors an address range or a sector mask covers */
+#define CBL_ERASE_RANGE_CMD         0x32
+/* Background erase, overlapped with the next write frames, and its progress */
+#define CBL_ERASE_START_CMD         0x33
+#define CBL_ERASE_STATUS_CMD        0x34
+
+/* !< The opcode range covered by the command table */
+#define BL_FIRST_COMMAND			CBL_GET_VER_CMD
+#define BL_LAST_COMMAND				CBL_ERASE_STATUS_CMD
+#define BL_COMMAND_COUNT			(BL_LAST_COMMAND - BL_FIRST_COMMAND + 1)
 
 /* !< The UART Module Configurations Object */
 #define BOOTLOADER_UART_OBJECT		&huart2
@@ -47,8 +90,14 @@
 /* !< The CRC Module Configurations Object */
 #define BOOTLOADER_CRC_OBJECT		&hcrc
 
+/* !< The Maximum data bytes carried by a single v2 frame */
+#define BL_FRAME_V2_MAX_DATA_SIZE	4096
+/* !< The Maximum v2 payload: the data plus the command fields (address, length...) */
+#define BL_FRAME_V2_MAX_PAYLOAD_SIZE	(BL_FRAME_V2_MAX_DATA_SIZE + 16)
+
 /* !< The Maximum received buffer size in bytes */
-#define BOOTLOADER_MAX_BUFFER_SIZE	100
+#define BOOTLOADER_MAX_BUFFER_SIZE	(HOST_LINK_FRAME_V2_HEADER_SIZE + BL_FRAME_V2_MAX_PAYLOAD_SIZE \
+										+ HOST_LINK_FRAME_CRC_SIZE)
 
 /* !< The Reset value for the received buffer */
 #define BOOTLOADER_BUFFER_RESET		0
@@ -56,9 +105,73 @@
 /* !< Bootlaoder version details */
 #define BL_VENDOR_ID				0x22
 #define BL_MAJOR_VERSION			0x01
-#define BL_MINOR_VERSION			0x00
+#define BL_MINOR_VERSION			0x01
 #define BL_PATCH_VERSION			0x00
 
+/* !< Capability bits, reported after the version by CBL_GET_VER_CMD */
+#define BL_CAP_FRAME_V2				(1UL << 0)
+#define BL_CAP_WRITE_WINDOW			(1UL << 1)
+#define BL_CAP_BAUD_SWITCH			(1UL << 2)
+#define BL_CAP_COMMAND_STATS		(1UL << 3)
+#define BL_CAP_COMPRESSED_WRITE		(1UL << 4)
+#define BL_CAP_DELTA_UPDATE			(1UL << 5)
+#define BL_CAP_BLOCK_CRC			(1UL << 6)
+#define BL_CAP_RANGE_CRC			(1UL << 7)
+#define BL_CAP_CRC_BENCHMARK		(1UL << 8)
+#define BL_CAP_STREAM_READ			(1UL << 9)
+#define BL_CAP_COMPRESSED_READ		(1UL << 10)
+#define BL_CAP_MEM_FILL				(1UL << 11)
+#define BL_CAP_MEM_COPY				(1UL << 12)
+#define BL_CAP_SPARSE_WRITE			(1UL << 13)
+#define BL_CAP_ERASE_RANGE			(1UL << 14)
+#define BL_CAP_BACKGROUND_ERASE		(1UL << 15)
+
+#define BL_CAPABILITIES				(BL_CAP_FRAME_V2 \
+									| (BL_ENABLE_PIPELINED_WRITE ? BL_CAP_WRITE_WINDOW : 0) \
+									| (BL_ENABLE_BAUD_SWITCH ? BL_CAP_BAUD_SWITCH : 0) \
+									| (BL_ENABLE_COMMAND_STATS ? BL_CAP_COMMAND_STATS : 0) \
+									| (BL_ENABLE_COMPRESSED_WRITE ? BL_CAP_COMPRESSED_WRITE : 0) \
+									| (BL_ENABLE_DELTA_UPDATE ? BL_CAP_DELTA_UPDATE : 0) \
+									| (BL_ENABLE_BLOCK_CRC ? BL_CAP_BLOCK_CRC : 0) \
+									| (BL_ENABLE_RANGE_CRC ? BL_CAP_RANGE_CRC : 0) \
+									| (BL_ENABLE_CRC_BENCHMARK ? BL_CAP_CRC_BENCHMARK : 0) \
+									| (BL_ENABLE_MEM_READ ? BL_CAP_STREAM_READ : 0) \
+									| ((BL_ENABLE_MEM_READ && BL_ENABLE_COMPRESSED_READ) ? BL_CAP_COMPRESSED_READ : 0) \
+									| (BL_ENABLE_MEM_FILL ? BL_CAP_MEM_FILL : 0) \
+									| (BL_ENABLE_MEM_COPY ? BL_CAP_MEM_COPY : 0) \
+									| (BL_ENABLE_SPARSE_WRITE ? BL_CAP_SPARSE_WRITE : 0) \
+									| (BL_ENABLE_ERASE_RANGE ? BL_CAP_ERASE_RANGE : 0) \
+									| (BL_ENABLE_BACKGROUND_ERASE ? BL_CAP_BACKGROUND_ERASE : 0))
+
+/* !< Largest write window, bounded by the received frames bitmap */
+#define BL_MAX_WRITE_WINDOW			WRITE_WINDOW_MAX_SIZE
+
+/* !< Streaming read: data bytes between two chunk CRCs, a chunk and its CRC fill one transmission */
+#define BL_READ_STREAM_CHUNK_SIZE	4096
+/* !< Streaming read: [Encoding:8][Reserved:8][Stored Length:16] in front of encoded chunks */
+#define BL_READ_CHUNK_HEADER_SIZE	4
+
+/* !< Compressed write: the most bytes a single block may decode to */
+#define BL_MAX_DECODED_BLOCK_SIZE	0x8000
+/* !< Compressed write: decoded bytes staged in RAM before programming */
+#define BL_DECODE_STAGING_SIZE		256
+/* !< Compressed write flag: the block continues the previous one, LZ4
+ *    matches may refer to the blocks already written */
+#define BL_COMPRESSED_LINKED		0x01
+
+/* !< Memory copy flag: erase every sector the destination touches first */
+#define BL_COPY_ERASE				0x01
+
+/* !< Sparse write: [Offset:16][Length:16] in front of every extent */
+#define BL_SPARSE_EXTENT_HEADER_SIZE	4
+
+/* !< Erase range: the sectors below the application hold the bootloader */
+#define BL_PROTECTED_SECTORS_MASK	((1UL << USER_APPLICATION_SECTOR) - 1)
+
+/* !< Block CRC table: smallest block, and CRCs computed per transmission */
+#define BL_MIN_CRC_BLOCK_SIZE		256
+#define BL_CRC_TABLE_CHUNK			32
+
 /* !< Bootloader ACK message */
 #define BL_ACK_MESSAGE				0xDD
 /* !< Bootloader NACK message */
@@ -67,6 +180,26 @@
 #define FLASH_SECTOR_2_BASE_ADD		0x08008000
 #define FLASH_SECTOR_4_BASE_ADD		0x08010000
 
+#if USER_APPLICATION_SECTOR == FLASH_SECTOR_2
+#define BL_USER_APP_BASE_ADD		FLASH_SECTOR_2_BASE_ADD
+#elif USER_APPLICATION_SECTOR == FLASH_SECTOR_4
+#define BL_USER_APP_BASE_ADD		FLASH_SECTOR_4_BASE_ADD
+#endif
+
+/* !< Delta update: the new image is built in the last sector, then copied
+ *    over the application. The commit marker sits in the last 8 bytes. */
+#define BL_DELTA_STAGING_SECTOR		FLASH_SECTOR_5
+#define BL_DELTA_STAGING_ADD		0x08020000
+#define BL_DELTA_STAGING_SIZE		0x20000
+#define BL_DELTA_MARKER_ADD			(BL_DELTA_STAGING_ADD + BL_DELTA_STAGING_SIZE - 8)
+/* !< The old and the new image both live below the staging sector */
+#define BL_DELTA_MAX_IMAGE_SIZE		(BL_DELTA_STAGING_ADD - BL_USER_APP_BASE_ADD)
+
+/* !< Delta patch instructions, COPY offsets are relative to the installed image */
+#define BL_DELTA_OP_END				COMPRESSION_PATCH_END
+#define BL_DELTA_OP_COPY			COMPRESSION_PATCH_COPY
+#define BL_DELTA_OP_INSERT			COMPRESSION_PATCH_INSERT
+
 #define BL_VALID_ADDRESS			(uint8_t)0x01
 #define BL_INVALID_ADDRESS			(uint8_t)0x00
 /* --------------- Section: External Variables --------------- */
@@ -88,10 +221,66 @@ typedef enum
 	CRC_NOT_MATCH
 } CRC_State_t;
 
+typedef enum
+{
+	BL_FRAME_V1 = 1,
+	BL_FRAME_V2 = 2
+} BL_Frame_Version_t;
+
+/* !< Frame versions a command accepts, BL_Frame_Version_t values as bits */
+#define BL_FRAMES_V1				((uint8_t)BL_FRAME_V1)
+#define BL_FRAMES_V2				((uint8_t)BL_FRAME_V2)
+#define BL_FRAMES_ANY				(BL_FRAMES_V1 | BL_FRAMES_V2)
+
+/* !< What a command does with a frame whose CRC doesn't match */
+typedef enum
+{
+	BL_CRC_DROP,		/* !< Ignore the frame, the host times out or retries */
+	BL_CRC_NACK			/* !< Answer with a NACK */
+} BL_CRC_Policy_t;
+
+/* !< Command table entry, the table is indexed by (opcode - BL_FIRST_COMMAND) */
+typedef struct
+{
+	uint8_t opcode;
+	uint8_t frames;				/* !< BL_FRAMES_V1 and/or BL_FRAMES_V2 */
+	BL_CRC_Policy_t crcPolicy;
+	uint16_t minPayload;		/* !< Accepted payload length range in bytes */
+	uint16_t maxPayload;
+	BL_ReturnType_t (* handler) (void);	/* !< NULL for unknown or stripped opcodes */
+} BL_Command_t;
+
+/* !< Per command counters, CBL_GET_STATS_CMD reply layout */
+typedef struct
+{
+	uint32_t calls;
+	uint32_t failures;
+	uint32_t totalCycles;		/* !< Wraps, the host works with differences */
+	uint32_t maxCycles;
+} BL_Command_Stats_t;
+
+/* !< Written behind the staged image once it is complete and verified */
+typedef struct
+{
+	uint32_t imageLength;
+	uint32_t imageCRC;			/* !< Crc_Calculate_Words() over the 0xFF padded words */
+} BL_Delta_Marker_t;
+
+/* !< Decoded view of the received frame */
+typedef struct
+{
+	BL_Frame_Version_t version;
+	uint8_t command;
+	uint16_t payloadLength;		/* !< Bytes between the command header and the CRC */
+	uint8_t *payload;			/* !< Word aligned for v2 frames */
+} BL_Frame_t;
+
 typedef void (* pToFun) (void);
 
 /*---------------  Section: Function Declarations --------------- */
 
 BL_ReturnType_t Bootloader_Fetch_Host_Command(void);
 
+void Bootloader_Wait_For_Event(void);
+
 #endif /* INC_BOOTLOADER_BOOTLOADER_H_ */
@@ -0,0 +1,30 @@
+/**
+ ******************************************************************************
+ * @file           : clockServices.h
+ * @author         : Mostafa Asaad (https://github.com/M0stafa077)
+ * @brief          : System clock profiles interface
+ ******************************************************************************
+ */
+
+#ifndef INC_CLOCKSERVICES_CLOCKSERVICES_H_
+#define INC_CLOCKSERVICES_CLOCKSERVICES_H_
+
+/*---------------  Section: Includes --------------- */
+
+#include "stm32f4xx_hal.h"
+#include "Bootloader/Bootloader_Cfg.h"
+
+/* --------------- Section: Macros Declarations --------------- */
+
+/* !< Clock profiles, selected by BL_CLOCK_PROFILE in Bootloader_Cfg.h */
+#define BL_CLOCK_PROFILE_HSI_16MHZ		0	/* !< The reset clock, no PLL */
+#define BL_CLOCK_PROFILE_HSI_PLL_84MHZ	1	/* !< HSI -> PLL, SYSCLK 84 MHz, APB1 42 MHz */
+#define BL_CLOCK_PROFILE_HSE_PLL_84MHZ	2	/* !< HSE -> PLL, SYSCLK 84 MHz, APB1 42 MHz */
+
+/*---------------  Section: Functions Declaration --------------- */
+
+HAL_StatusTypeDef Clock_Enter_Session_Profile(void);
+
+HAL_StatusTypeDef Clock_Restore_Reset_Profile(void);
+
+#endif /* INC_CLOCKSERVICES_CLOCKSERVICES_H_ */
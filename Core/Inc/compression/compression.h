@@ -0,0 +1,86 @@
+/**
+ ******************************************************************************
+ * @file           : compression.h
+ * @author         : Mostafa Asaad (https://github.com/M0stafa077)
+ * @brief          : Streaming block decoder and block encoder interface.
+ *                   Blocks are decoded into a small staging buffer that is
+ *                   flushed to a sink (e.g. the flash) whenever it fills up.
+ *                   LZ matches may reach back into the already flushed
+ *                   output, which is read back from where it was written,
+ *                   so the history window costs no RAM.
+ *                   Encoded blocks stand alone, any RLE / LZ4 block
+ *                   decoder (this one included) restores them.
+ *                   This module has no HAL dependency.
+ ******************************************************************************
+ */
+
+#ifndef INC_COMPRESSION_COMPRESSION_H_
+#define INC_COMPRESSION_COMPRESSION_H_
+
+/*---------------  Section: Includes --------------- */
+
+#include <stdint.h>
+
+/* --------------- Section: Macros Declarations --------------- */
+
+#define COMPRESSION_OK					0x0
+#define COMPRESSION_CORRUPT				0x1		/* !< Malformed or truncated input */
+#define COMPRESSION_OVERFLOW			0x2		/* !< Decodes to more than the output limit */
+#define COMPRESSION_SINK_ERROR			0x3		/* !< The sink refused a flush */
+
+/* !< Block encodings */
+#define COMPRESSION_RAW					0x0
+/* Control byte c: bit 7 set => the next byte repeated (c & 0x7F) + 1 times,
+ *                 otherwise => the next c + 1 bytes copied as they are */
+#define COMPRESSION_RLE					0x1
+/* LZ4 block format (no frame header, no checksum) */
+#define COMPRESSION_LZ4					0x2
+
+/* !< Patch instructions, Compression_Apply_Patch() */
+#define COMPRESSION_PATCH_END			0x00	/* !< The rest of the patch is padding */
+#define COMPRESSION_PATCH_COPY			0x01	/* !< [Source Offset:32][Length:32] */
+#define COMPRESSION_PATCH_INSERT		0x02	/* !< [Encoding:8][Length:16][Encoded Data] */
+
+/* !< Largest block the LZ4 encoder takes, its match positions are 16 bit */
+#define COMPRESSION_LZ4_MAX_BLOCK		0xFFFFU
+/* !< LZ4 encoder hash table entries, a power of 2 (2 bytes of RAM each) */
+#define COMPRESSION_LZ4_HASH_BITS		10U
+
+/*---------------  Section: Types Declarations --------------- */
+
+/* !< Receives the staging buffer when it is full, and the tail at the end.
+ *    The length is a multiple of 4 except for the tail. Returns 0 on success. */
+typedef uint8_t (* Compression_Sink_t) (uint32_t offset, const uint8_t *data, uint32_t length);
+
+typedef struct
+{
+	uint8_t *staging;				/* !< Decoded bytes not flushed yet */
+	uint32_t stagingSize;			/* !< A multiple of 4 */
+	uint32_t stagingFill;
+	const uint8_t *flushed;			/* !< Where the flushed output reads back, NULL if it can't */
+	uint32_t flushedLength;			/* !< Output bytes handed to the sink */
+	uint32_t limit;					/* !< Total output bytes allowed */
+	Compression_Sink_t sink;
+} Compression_Output_t;
+
+/*---------------  Section: Functions Declaration --------------- */
+
+void Compression_Output_Init(Compression_Output_t *output, uint8_t *staging, uint32_t stagingSize,
+		const uint8_t *flushed, uint32_t limit, Compression_Sink_t sink);
+
+void Compression_Output_Set_History(Compression_Output_t *output, uint32_t historyLength);
+
+uint8_t Compression_Decode(Compression_Output_t *output, uint8_t encoding,
+		const uint8_t *input, uint32_t inputLength);
+
+uint8_t Compression_Apply_Patch(Compression_Output_t *output, const uint8_t *source, uint32_t sourceLength,
+		const uint8_t *patch, uint32_t patchLength);
+
+uint8_t Compression_Output_Finish(Compression_Output_t *output);
+
+uint32_t Compression_Output_Length(const Compression_Output_t *output);
+
+uint32_t Compression_Encode(uint8_t encoding, const uint8_t *input, uint32_t inputLength,
+		uint8_t *output, uint32_t outputSize);
+
+#endif /* INC_COMPRESSION_COMPRESSION_H_ */
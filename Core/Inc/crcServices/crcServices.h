@@ -0,0 +1,47 @@
+/**
+ ******************************************************************************
+ * @file           : crcServices.h
+ * @author         : Mostafa Asaad (https://github.com/M0stafa077)
+ * @brief          : CRC unit services interface
+ ******************************************************************************
+ */
+
+#ifndef INC_CRCSERVICES_CRCSERVICES_H_
+#define INC_CRCSERVICES_CRCSERVICES_H_
+
+/*---------------  Section: Includes --------------- */
+
+#include "stm32f4xx_hal.h"
+#include "stm32f4xx_ll_crc.h"
+#include "Bootloader/Bootloader_Cfg.h"
+#include "crcServices/crcSoftware.h"
+
+/* --------------- Section: Macros Declarations --------------- */
+
+/* !< Ranges shorter than this are fed by the CPU, the DMA setup costs more */
+#define CRC_DMA_MIN_WORDS				64U
+
+/* !< Most words the DMA moves in one transfer (16-bit NDTR) */
+#define CRC_DMA_MAX_WORDS				0xFFFFU
+
+/* !< Per transfer time limit */
+#define CRC_DMA_TIMEOUT_MS				100U
+
+/* --------------- Section: External Variables --------------- */
+
+extern CRC_HandleTypeDef hcrc;
+extern DMA_HandleTypeDef hdma_memtomem_dma2_stream0;
+
+/*---------------  Section: Functions Declaration --------------- */
+
+uint32_t Crc_Calculate_Range(uint32_t address, uint32_t length);
+
+uint32_t Crc_Calculate_Words(const uint32_t *words, uint32_t wordCount);
+
+uint32_t Crc_Calculate_Bytes(const uint8_t *bytes, uint32_t length);
+
+uint8_t Crc_Self_Test(void);
+
+void Crc_DeInit(void);
+
+#endif /* INC_CRCSERVICES_CRCSERVICES_H_ */
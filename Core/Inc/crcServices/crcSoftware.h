@@ -0,0 +1,49 @@
+/**
+ ******************************************************************************
+ * @file           : crcSoftware.h
+ * @author         : Mostafa Asaad (https://github.com/M0stafa077)
+ * @brief          : Software CRC kernels interface.
+ *                   Bit exact with the STM32 CRC unit: polynomial 0x04C11DB7,
+ *                   MSB first, no reflection, no final xor. The unit takes
+ *                   whole words, so a byte is fed as a zero extended word.
+ *                   Every kernel gives the same result:
+ *                   - Bitwise: 32 shift steps per word, no table.
+ *                   - Table: 4 byte steps per word, one 1 KB const table.
+ *                   - Slicing by 4 / 8: one or two words per step, with
+ *                     7 KB of RAM tables built on the first call. Unused
+ *                     kernels and their tables are dropped by the linker.
+ *                   This module has no HAL dependency, host tools build it
+ *                   as is.
+ ******************************************************************************
+ */
+
+#ifndef INC_CRCSERVICES_CRCSOFTWARE_H_
+#define INC_CRCSERVICES_CRCSOFTWARE_H_
+
+/*---------------  Section: Includes --------------- */
+
+#include <stdint.h>
+
+/* --------------- Section: Macros Declarations --------------- */
+
+#define CRC_SOFTWARE_POLYNOMIAL			0x04C11DB7UL
+/* !< The value the CRC unit resets to, start every calculation with it */
+#define CRC_SOFTWARE_INIT				0xFFFFFFFFUL
+
+/*---------------  Section: Functions Declaration --------------- */
+
+uint32_t Crc_Bitwise_Words(uint32_t crc, const uint32_t *words, uint32_t wordCount);
+
+uint32_t Crc_Bitwise_Bytes(uint32_t crc, const uint8_t *bytes, uint32_t length);
+
+uint32_t Crc_Table_Words(uint32_t crc, const uint32_t *words, uint32_t wordCount);
+
+uint32_t Crc_Table_Bytes(uint32_t crc, const uint8_t *bytes, uint32_t length);
+
+uint32_t Crc_Slice4_Words(uint32_t crc, const uint32_t *words, uint32_t wordCount);
+
+uint32_t Crc_Slice4_Bytes(uint32_t crc, const uint8_t *bytes, uint32_t length);
+
+uint32_t Crc_Slice8_Words(uint32_t crc, const uint32_t *words, uint32_t wordCount);
+
+#endif /* INC_CRCSERVICES_CRCSOFTWARE_H_ */
@@ -19,11 +19,33 @@
 #define E_OK    						0x0
 #define E_NOT_OK    					0x1
 
+/* !< Returned by Flash_Get_Sector() for an address outside the flash */
+#define FLASH_INVALID_SECTOR			0xFFFFFFFFUL
+/* !< Sector mask of the whole flash */
+#define FLASH_ALL_SECTORS_MASK			((1UL << FLASH_SECTOR_TOTAL) - 1)
+
 typedef uint8_t Std_ReturnType_t;
 
 /*---------------  Section: Functions Declaration --------------- */
 
 Std_ReturnType_t Flash_Erase_Mass(void);
 HAL_StatusTypeDef flashWrite(uint32_t address, uint8_t* data, uint32_t length) ;
+HAL_StatusTypeDef flashWriteWords(uint32_t address, const uint32_t* data, uint32_t wordCount);
+HAL_StatusTypeDef Flash_Fill_Words(uint32_t address, uint32_t pattern, uint32_t wordCount);
+HAL_StatusTypeDef Flash_Erase_Sectors(uint32_t firstSector, uint32_t sectorCount);
+uint32_t Flash_Get_Sector(uint32_t address);
+uint32_t Flash_Get_Sector_Base(uint32_t sector);
+uint32_t Flash_Plan_Erase(uint32_t address, uint32_t length);
+uint32_t Flash_Get_Last_Error(void);
+uint32_t Flash_Get_Blank_Sectors(uint32_t sectorMask);
+uint32_t Flash_Get_Skipped_Sectors(void);
+HAL_StatusTypeDef Flash_Session_Begin(void);
+HAL_StatusTypeDef Flash_Session_Program(uint32_t address, const uint32_t* data, uint32_t wordCount);
+HAL_StatusTypeDef Flash_Session_End(void);
+HAL_StatusTypeDef Flash_Erase_Start(uint32_t sectorMask);
+void Flash_Erase_Wait(uint32_t sectorMask);
+uint32_t Flash_Erase_Pending(void);
+uint32_t Flash_Erase_Done(void);
+void Flash_Erase_IRQ_Handler(void);
 
 #endif /* INC_FLASHSERVICES_FLASHSERVICES_H_ */
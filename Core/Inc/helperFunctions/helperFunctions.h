@@ -25,9 +25,13 @@ void turnLedOn(void);
 
 void turnLedOff(void);
 
-HAL_StatusTypeDef sendToHost(uint8_t * message, uint8_t length);
+void setStatusLedBusy(uint8_t busy);
 
-HAL_StatusTypeDef receiveFromHost(uint8_t * buffer, uint8_t length);
+void updateStatusLed(void);
+
+HAL_StatusTypeDef sendToHost(uint8_t * message, uint32_t length);
+
+HAL_StatusTypeDef receiveFromHost(uint8_t * buffer, uint32_t length);
 
 void sendDebuggingMessage(uint8_t * message, uint8_t length);
 
@@ -0,0 +1,88 @@
+/**
+ ******************************************************************************
+ * @file           : hostLink.h
+ * @author         : Mostafa Asaad (https://github.com/M0stafa077)
+ * @brief          : Host UART link interface (DMA reception and framing)
+ ******************************************************************************
+ */
+
+#ifndef INC_HOSTLINK_HOSTLINK_H_
+#define INC_HOSTLINK_HOSTLINK_H_
+
+/*---------------  Section: Includes --------------- */
+
+#include "stm32f4xx_hal.h"
+#include "ringBuffer/ringBuffer.h"
+
+/* --------------- Section: Macros Declarations --------------- */
+
+/* !< Size of the circular DMA reception ring, must be a power of two
+ *    and hold at least one maximum size frame */
+#define HOST_LINK_RX_RING_SIZE			8192U
+
+/* !< A partially received frame is resynchronised past after this much line silence */
+#define HOST_LINK_FRAME_TIMEOUT_MS		100U
+
+/*
+ * !< Frame formats
+ *    v1: [N:8][N bytes, ending with the CRC]
+ *    v2: [0x00][CMD:8][N:16][N bytes payload][CRC:32], little endian,
+ *        N a multiple of 4 so every 32-bit field stays naturally aligned.
+ *    A v1 frame never starts with 0x00, which selects the v2 format.
+ */
+#define HOST_LINK_FRAME_V2_MARKER		0x00U
+/* !< Smallest v1 N: the command and the CRC */
+#define HOST_LINK_FRAME_V1_MIN_LENGTH	5U
+#define HOST_LINK_FRAME_V2_HEADER_SIZE	4U
+#define HOST_LINK_FRAME_CRC_SIZE		4U
+
+/* !< Size of each of the two transmit staging buffers */
+#define HOST_LINK_TX_BUFFER_SIZE		4128U
+
+/* !< Longest wait for a transmit staging buffer to free up */
+#define HOST_LINK_TX_TIMEOUT_MS			1000U
+
+/* !< Largest accepted deviation from a requested baud rate, in per mille */
+#define HOST_LINK_MAX_BAUD_ERROR		20U
+
+/* !< Frames assembled ahead of the one being processed (2 = ping-pong) */
+#define HOST_LINK_FRAME_SLOTS			2U
+/* !< Frame slot size, must hold BOOTLOADER_MAX_BUFFER_SIZE */
+#define HOST_LINK_FRAME_SLOT_SIZE		4120U
+
+/*---------------  Section: Types Declarations --------------- */
+
+/* !< One piece of a gathered transmission */
+typedef struct
+{
+	const void *data;
+	uint32_t length;
+} HostLink_Segment_t;
+
+/*---------------  Section: Functions Declaration --------------- */
+
+HAL_StatusTypeDef HostLink_Init(void);
+
+void HostLink_DeInit(void);
+
+uint8_t *HostLink_Acquire_Frame(uint32_t *frameLength);
+
+void HostLink_Release_Frame(void);
+
+uint8_t HostLink_Frame_Pending(void);
+
+uint32_t HostLink_Get_Dropped_Frames(void);
+
+HAL_StatusTypeDef HostLink_Receive(uint8_t *buffer, uint32_t length, uint32_t timeout);
+
+HAL_StatusTypeDef HostLink_Transmit(const HostLink_Segment_t *segments, uint32_t segmentCount);
+
+HAL_StatusTypeDef HostLink_Flush(void);
+
+uint32_t HostLink_Achievable_Baud_Rate(uint32_t baudRate);
+
+HAL_StatusTypeDef HostLink_Set_Baud_Rate(uint32_t baudRate);
+
+uint32_t HostLink_Get_Baud_Rate(void);
+
+#endif /* INC_HOSTLINK_HOSTLINK_H_ */
@@ -0,0 +1,52 @@
+/**
+ ******************************************************************************
+ * @file           : ringBuffer.h
+ * @author         : Mostafa Asaad (https://github.com/M0stafa077)
+ * @brief          : Single producer / single consumer byte ring interface.
+ *                   The producer is expected to be a circular DMA stream that
+ *                   reports its write position, the consumer is the main loop.
+ *                   This module has no HAL dependency.
+ ******************************************************************************
+ */
+
+#ifndef INC_RINGBUFFER_RINGBUFFER_H_
+#define INC_RINGBUFFER_RINGBUFFER_H_
+
+/*---------------  Section: Includes --------------- */
+
+#include <stdint.h>
+
+/* --------------- Section: Macros Declarations --------------- */
+
+#define RING_BUFFER_OK					0x0
+#define RING_BUFFER_OVERRUN				0x1
+
+/*---------------  Section: Types Declarations --------------- */
+
+typedef struct
+{
+	uint8_t *storage;				/* !< Backing storage, written by the producer */
+	uint32_t size;					/* !< Storage size, must be a power of two */
+	uint32_t writeIndex;			/* !< Last producer position reported in [0, size) */
+	volatile uint32_t produced;		/* !< Total bytes produced (free running) */
+	volatile uint32_t consumed;		/* !< Total bytes consumed (free running) */
+	volatile uint8_t overrun;		/* !< Set when the producer lapped the consumer */
+} RingBuffer_t;
+
+/*---------------  Section: Functions Declaration --------------- */
+
+void RingBuffer_Init(RingBuffer_t *ring, uint8_t *storage, uint32_t size);
+
+void RingBuffer_Produce(RingBuffer_t *ring, uint32_t position);
+
+uint32_t RingBuffer_Count(const RingBuffer_t *ring);
+
+uint8_t RingBuffer_Peek(const RingBuffer_t *ring, uint32_t offset);
+
+uint32_t RingBuffer_Read(RingBuffer_t *ring, uint8_t *destination, uint32_t length);
+
+void RingBuffer_Discard(RingBuffer_t *ring, uint32_t length);
+
+uint8_t RingBuffer_Take_Overrun(RingBuffer_t *ring);
+
+#endif /* INC_RINGBUFFER_RINGBUFFER_H_ */
@@ -0,0 +1,45 @@
+/**
+ ******************************************************************************
+ * @file           : writeWindow.h
+ * @author         : Mostafa Asaad (https://github.com/M0stafa077)
+ * @brief          : Receiver side bookkeeping of the pipelined write protocol
+ *                   interface. Tracks the frames received in a sliding window
+ *                   of 16 bit sequence numbers, the cumulative ACK and the
+ *                   gaps to NACK. This module has no HAL dependency.
+ ******************************************************************************
+ */
+
+#ifndef INC_WRITEWINDOW_WRITEWINDOW_H_
+#define INC_WRITEWINDOW_WRITEWINDOW_H_
+
+/*---------------  Section: Includes --------------- */
+
+#include <stdint.h>
+
+/* --------------- Section: Macros Declarations --------------- */
+
+/* !< Largest window, bounded by the received frames bitmap */
+#define WRITE_WINDOW_MAX_SIZE			32U
+
+#define WRITE_WINDOW_NEW				0x0		/* !< In the window and not received yet */
+#define WRITE_WINDOW_DUPLICATE			0x1		/* !< Received already, or outside the window */
+
+/*---------------  Section: Types Declarations --------------- */
+
+typedef struct
+{
+	uint16_t windowSize;		/* !< Negotiated number of outstanding frames */
+	uint16_t baseSequence;		/* !< Oldest sequence number not yet received */
+	uint32_t receivedMask;		/* !< Bit i: baseSequence + i was programmed */
+	uint32_t nackedMask;		/* !< Bit i: baseSequence + i was already NACKed */
+} WriteWindow_t;
+
+/*---------------  Section: Functions Declaration --------------- */
+
+uint16_t WriteWindow_Init(WriteWindow_t *window, uint32_t windowSize);
+
+uint8_t WriteWindow_Classify(const WriteWindow_t *window, uint16_t sequence);
+
+uint32_t WriteWindow_Receive(WriteWindow_t *window, uint16_t sequence);
+
+#endif /* INC_WRITEWINDOW_WRITEWINDOW_H_ */
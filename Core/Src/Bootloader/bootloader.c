@@ -12,7 +12,46 @@
 
 /*---------------  Section: Global Variables --------------- */
 
-static uint8_t receivedBuffer[BOOTLOADER_MAX_BUFFER_SIZE];
+#if (BOOTLOADER_MAX_BUFFER_SIZE > HOST_LINK_FRAME_SLOT_SIZE)
+#error "The host link frame slots can't hold the largest frame"
+#endif
+
+#if ((BL_READ_STREAM_CHUNK_SIZE + BL_READ_CHUNK_HEADER_SIZE + 16) > HOST_LINK_TX_BUFFER_SIZE)
+#error "A streamed read chunk, its CRC and the ACK must fit one transmission"
+#endif
+
+/* !< The frame being processed, a word aligned host link frame slot */
+static uint8_t *receivedBuffer;
+static BL_Frame_t hostFrame;
+#if BL_ENABLE_PIPELINED_WRITE
+static WriteWindow_t writeWindow = { .windowSize = 1 };
+#endif
+
+#if BL_ENABLE_COMPRESSED_WRITE
+/* !< Decoded bytes waiting to be programmed */
+static uint8_t decodeStaging[BL_DECODE_STAGING_SIZE] __ALIGNED(4);
+/* !< Flash range written by the current chain of linked blocks */
+static uint32_t compressedStreamStart = 0;
+static uint32_t compressedStreamEnd = 0;
+#endif
+
+#if BL_ENABLE_DELTA_UPDATE
+/* !< The patch output stream, kept across the patch frames */
+static uint8_t deltaStaging[BL_DECODE_STAGING_SIZE] __ALIGNED(4);
+static Compression_Output_t deltaOutput;
+/* !< Set between a delta begin and its commit */
+static uint8_t deltaActive = 0;
+static BL_Delta_Marker_t deltaImage;
+#endif
+
+#if BL_ENABLE_MEM_READ && BL_ENABLE_COMPRESSED_READ
+/* !< The encoded chunk of a compressed streaming read */
+static uint8_t readEncodeBuffer[BL_READ_STREAM_CHUNK_SIZE];
+#endif
+
+/* !< Set after a baud rate switch until the host probe arrives */
+static uint8_t baudProbePending = 0;
+static uint32_t baudProbeStartTick = 0;
 
 /*---------------  Section: Static Functions Declaration --------------- */
 static BL_ReturnType_t Bootloader_Get_Version(void);
@@ -20,203 +59,272 @@ static BL_ReturnType_t Bootloader_Get_Help(void);
 static BL_ReturnType_t Bootloader_Get_Chip_ID(void);
 static BL_ReturnType_t Bootloader_Get_RDP_Status(void);
 static BL_ReturnType_t Bootloader_Jump_To_User_App();
+#if BL_ENABLE_GO_TO_ADDR
 static BL_ReturnType_t Bootloader_GoTo_Address(void);
+#endif
 static BL_ReturnType_t Bootloader_EraseFlash(void);
 static BL_ReturnType_t Bootloader_writeFlashMemory(void);
+#if BL_ENABLE_MEM_READ
 static BL_ReturnType_t Bootloader_readFromFlash(void);
+static BL_ReturnType_t Bootloader_readFromFlash_V2(void);
+static BL_ReturnType_t Bootloader_readFromFlash_Stream(void);
+#endif
+#if BL_ENABLE_PIPELINED_WRITE
+static BL_ReturnType_t Bootloader_Configure_Window(void);
+static BL_ReturnType_t Bootloader_writeFlashMemory_Seq(void);
+#endif
+#if BL_ENABLE_BAUD_SWITCH
+static BL_ReturnType_t Bootloader_Set_Baud_Rate(void);
+#endif
+#if BL_ENABLE_COMMAND_STATS
+static BL_ReturnType_t Bootloader_Get_Stats(void);
+#endif
+#if BL_ENABLE_COMPRESSED_WRITE
+static BL_ReturnType_t Bootloader_writeFlashMemory_Compressed(void);
+static uint8_t BL_Program_Decoded(uint32_t offset, const uint8_t *data, uint32_t length);
+#endif
+#if BL_ENABLE_DELTA_UPDATE
+static BL_ReturnType_t Bootloader_Delta_Begin(void);
+static BL_ReturnType_t Bootloader_Delta_Patch(void);
+static BL_ReturnType_t Bootloader_Delta_Commit(void);
+static uint8_t BL_Program_Staged(uint32_t offset, const uint8_t *data, uint32_t length);
+static uint8_t BL_Staged_Image_Valid(const BL_Delta_Marker_t *marker);
+#endif
+#if BL_ENABLE_BLOCK_CRC
+static BL_ReturnType_t Bootloader_Get_Block_CRC_Table(void);
+#endif
+#if BL_ENABLE_RANGE_CRC
+static BL_ReturnType_t Bootloader_Get_Range_CRC(void);
+#endif
+#if BL_ENABLE_CRC_BENCHMARK
+static BL_ReturnType_t Bootloader_CRC_Benchmark(void);
+#endif
+#if BL_ENABLE_MEM_FILL
+static BL_ReturnType_t Bootloader_Fill_Memory(void);
+#endif
+#if BL_ENABLE_MEM_COPY
+static BL_ReturnType_t Bootloader_Copy_Memory(void);
+#endif
+#if BL_ENABLE_SPARSE_WRITE
+static BL_ReturnType_t Bootloader_writeFlashMemory_Sparse(void);
+#endif
+#if BL_ENABLE_ERASE_RANGE
+static BL_ReturnType_t Bootloader_Erase_Range(void);
+#endif
+#if BL_ENABLE_BACKGROUND_ERASE
+static BL_ReturnType_t Bootloader_Erase_Start(void);
+static BL_ReturnType_t Bootloader_Erase_Status(void);
+#endif
+#if BL_ENABLE_ERASE_RANGE || BL_ENABLE_BACKGROUND_ERASE
+static uint32_t BL_Get_Erase_Plan(void);
+#endif
+#if BL_ENABLE_COMMAND_STATS || BL_ENABLE_CRC_BENCHMARK
+static inline void BL_Start_Cycle_Counter(void);
+#endif
+#if BL_ENABLE_COMPRESSED_WRITE || BL_ENABLE_DELTA_UPDATE
+static uint8_t BL_Program_Bytes(uint32_t address, const uint8_t *data, uint32_t length);
+#endif
 
-static BL_ReturnType_t BL_Send_ACK_Message(uint8_t Reply_Lenght);
+static BL_ReturnType_t BL_Send_ACK_Message(uint16_t Reply_Lenght);
+static BL_ReturnType_t BL_Send_Reply(const void *Reply, uint16_t Reply_Lenght);
+static uint32_t BL_Build_ACK_Header(uint8_t *Header, uint16_t Reply_Lenght);
 static BL_ReturnType_t BL_Send_NACK_Message();
+#if BL_ENABLE_PIPELINED_WRITE
+static BL_ReturnType_t BL_Send_Sequence_Reply(uint8_t Reply, uint16_t Sequence);
+#endif
 static CRC_State_t BL_Check_CRC_Matching();
+static void BL_Parse_Frame(void);
+static BL_ReturnType_t BL_Dispatch_Command(void);
+static const BL_Command_t *BL_Find_Command(uint8_t opcode);
+static void BL_Check_Baud_Probe(void);
+static uint32_t BL_Get_Payload_Word(uint16_t offset);
 static inline uint8_t BL_IsValidAddress(uint32_t userAddress);
-uint32_t calculateCRC32(const uint8_t* buffer, uint8_t bufferLength);
+static inline uint8_t BL_IsValidRange(uint32_t address, uint32_t length);
+
+/*---------------  Section: Command Table --------------- */
+
+#define BL_COMMAND(Opcode, Handler, Frames, CRC_Policy, Min_Payload, Max_Payload) \
+	[(Opcode) - BL_FIRST_COMMAND] = { (Opcode), (Frames), (CRC_Policy), (Min_Payload), (Max_Payload), (Handler) }
+
+/* !< Drives the dispatch, the validation and the help reply.
+ *    The payload ranges hold for both frame versions: v1 fields are packed,
+ *    v2 fields are padded to whole words. */
+static const BL_Command_t commandTable[BL_COMMAND_COUNT] = {
+	BL_COMMAND(CBL_GET_VER_CMD,        Bootloader_Get_Version,          BL_FRAMES_ANY, BL_CRC_DROP, 0, 0),
+	BL_COMMAND(CBL_GET_HELP_CMD,       Bootloader_Get_Help,             BL_FRAMES_ANY, BL_CRC_DROP, 0, 0),
+	BL_COMMAND(CBL_GET_CID_CMD,        Bootloader_Get_Chip_ID,          BL_FRAMES_ANY, BL_CRC_DROP, 0, 0),
+	BL_COMMAND(CBL_GET_RDP_STATUS_CMD, Bootloader_Get_RDP_Status,       BL_FRAMES_ANY, BL_CRC_DROP, 0, 0),
+#if BL_ENABLE_GO_TO_ADDR
+	BL_COMMAND(CBL_GO_TO_ADDR_CMD,     Bootloader_GoTo_Address,         BL_FRAMES_ANY, BL_CRC_DROP, 4, 4),
+#endif
+	BL_COMMAND(CBL_FLASH_ERASE_CMD,    Bootloader_EraseFlash,           BL_FRAMES_ANY, BL_CRC_DROP, 0, 0),
+	/* v1: [Address:32][Length:8][Data], v2: [Address:32][Data] */
+	BL_COMMAND(CBL_MEM_WRITE_CMD,      Bootloader_writeFlashMemory,     BL_FRAMES_ANY, BL_CRC_NACK, 5, BL_FRAME_V2_MAX_PAYLOAD_SIZE),
+#if BL_ENABLE_MEM_READ
+	/* v1: [Address:32][Words:8], v2: [Address:32][Length:32] */
+	BL_COMMAND(CBL_MEM_READ_CMD,       Bootloader_readFromFlash,        BL_FRAMES_ANY, BL_CRC_NACK, 5, 8),
+#endif
+	BL_COMMAND(CBL_GOTO_USER_APP_CMD,  Bootloader_Jump_To_User_App,     BL_FRAMES_ANY, BL_CRC_DROP, 0, 0),
+#if BL_ENABLE_PIPELINED_WRITE
+	BL_COMMAND(CBL_WINDOW_CFG_CMD,     Bootloader_Configure_Window,     BL_FRAMES_V2,  BL_CRC_NACK, 4, 4),
+	/* A damaged frame can't be NACKed by sequence number, the gap is NACKed later */
+	BL_COMMAND(CBL_MEM_WRITE_SEQ_CMD,  Bootloader_writeFlashMemory_Seq, BL_FRAMES_V2,  BL_CRC_DROP, 8, BL_FRAME_V2_MAX_PAYLOAD_SIZE),
+#endif
+#if BL_ENABLE_BAUD_SWITCH
+	BL_COMMAND(CBL_SET_BAUD_CMD,       Bootloader_Set_Baud_Rate,        BL_FRAMES_ANY, BL_CRC_NACK, 4, 4),
+#endif
+#if BL_ENABLE_COMMAND_STATS
+	/* v1: [Command:8], v2: [Command:8][Reserved:24] */
+	BL_COMMAND(CBL_GET_STATS_CMD,      Bootloader_Get_Stats,            BL_FRAMES_ANY, BL_CRC_NACK, 1, 4),
+#endif
+#if BL_ENABLE_COMPRESSED_WRITE
+	BL_COMMAND(CBL_MEM_WRITE_COMPRESSED_CMD, Bootloader_writeFlashMemory_Compressed, BL_FRAMES_V2, BL_CRC_NACK, 12, BL_FRAME_V2_MAX_PAYLOAD_SIZE),
+#endif
+#if BL_ENABLE_DELTA_UPDATE
+	BL_COMMAND(CBL_DELTA_BEGIN_CMD,    Bootloader_Delta_Begin,          BL_FRAMES_V2,  BL_CRC_NACK, 8, 8),
+	BL_COMMAND(CBL_DELTA_PATCH_CMD,    Bootloader_Delta_Patch,          BL_FRAMES_V2,  BL_CRC_NACK, 4, BL_FRAME_V2_MAX_PAYLOAD_SIZE),
+	BL_COMMAND(CBL_DELTA_COMMIT_CMD,   Bootloader_Delta_Commit,         BL_FRAMES_V2,  BL_CRC_NACK, 0, 0),
+#endif
+#if BL_ENABLE_BLOCK_CRC
+	BL_COMMAND(CBL_BLOCK_CRC_TABLE_CMD, Bootloader_Get_Block_CRC_Table, BL_FRAMES_ANY, BL_CRC_NACK, 12, 12),
+#endif
+#if BL_ENABLE_RANGE_CRC
+	BL_COMMAND(CBL_RANGE_CRC_CMD,      Bootloader_Get_Range_CRC,        BL_FRAMES_ANY, BL_CRC_NACK, 8, 8),
+#endif
+#if BL_ENABLE_CRC_BENCHMARK
+	BL_COMMAND(CBL_CRC_BENCHMARK_CMD,  Bootloader_CRC_Benchmark,        BL_FRAMES_ANY, BL_CRC_NACK, 8, 8),
+#endif
+#if BL_ENABLE_MEM_READ
+	/* [Address:32][Length:32], then [Encoding:8] (v1) or [Encoding:8][Reserved:24] (v2) */
+	BL_COMMAND(CBL_MEM_READ_STREAM_CMD, Bootloader_readFromFlash_Stream, BL_FRAMES_ANY, BL_CRC_NACK, 8,
+			BL_ENABLE_COMPRESSED_READ ? 12 : 8),
+#endif
+#if BL_ENABLE_MEM_FILL
+	BL_COMMAND(CBL_MEM_FILL_CMD,       Bootloader_Fill_Memory,          BL_FRAMES_ANY, BL_CRC_NACK, 12, 12),
+#endif
+#if BL_ENABLE_MEM_COPY
+	/* v1: [Source:32][Destination:32][Length:32][Flags:8], v2: [Flags:32] */
+	BL_COMMAND(CBL_MEM_COPY_CMD,       Bootloader_Copy_Memory,          BL_FRAMES_ANY, BL_CRC_NACK, 13, 16),
+#endif
+#if BL_ENABLE_SPARSE_WRITE
+	BL_COMMAND(CBL_MEM_WRITE_SPARSE_CMD, Bootloader_writeFlashMemory_Sparse, BL_FRAMES_V2, BL_CRC_NACK, 8, BL_FRAME_V2_MAX_PAYLOAD_SIZE),
+#endif
+#if BL_ENABLE_ERASE_RANGE
+	/* [Sector Mask:32] or [Address:32][Length:32] */
+	BL_COMMAND(CBL_ERASE_RANGE_CMD,    Bootloader_Erase_Range,          BL_FRAMES_ANY, BL_CRC_NACK, 4, 8),
+#endif
+#if BL_ENABLE_BACKGROUND_ERASE
+	/* [Sector Mask:32] or [Address:32][Length:32] */
+	BL_COMMAND(CBL_ERASE_START_CMD,    Bootloader_Erase_Start,          BL_FRAMES_ANY, BL_CRC_NACK, 4, 8),
+	BL_COMMAND(CBL_ERASE_STATUS_CMD,   Bootloader_Erase_Status,         BL_FRAMES_ANY, BL_CRC_DROP, 0, 0),
+#endif
+};
+
+#if BL_ENABLE_COMMAND_STATS
+static BL_Command_Stats_t commandStats[BL_COMMAND_COUNT];
+#endif
+
 /*---------------  Section: Function Definitions --------------- */
 
 BL_ReturnType_t Bootloader_Fetch_Host_Command(void)
 {
 	BL_ReturnType_t bootloaderStatus = BL_OK;
-	HAL_StatusTypeDef HAL_State = HAL_OK;
-	uint8_t packetLength = 0;
+	uint32_t frameLength = 0;
 
+	BL_Check_Baud_Probe();
 
-	/* Reset the Buffer */
-	memset(receivedBuffer, BOOTLOADER_BUFFER_RESET, BOOTLOADER_MAX_BUFFER_SIZE);
-
-	/* Receive the first byte => Data Length [N] */
-	HAL_State = receiveFromHost(receivedBuffer, 1);
+	/* Take a complete v1 or v2 frame if there is one. Frames are assembled in
+	 * the background, so the next one streams in while this one is processed */
+	receivedBuffer = HostLink_Acquire_Frame(&frameLength);
+	if(receivedBuffer == NULL) {
+		return BL_OK;
+	}
+	setStatusLedBusy(1);
 
-	if(HAL_State == HAL_OK)
+	if(frameLength > 1)
 	{
-		packetLength = *receivedBuffer;
-
-		/* Receive the Second Byte => The Command */
-		HAL_State = receiveFromHost(&receivedBuffer[1], packetLength);
-
-
-		if(HAL_State == HAL_OK) {
-			switch(receivedBuffer[1]) {
-				case CBL_GET_VER_CMD:
-					bootloaderStatus |= Bootloader_Get_Version();
-					break;
-				case CBL_GET_HELP_CMD:
-					bootloaderStatus |= Bootloader_Get_Help();
-					break;
-				case CBL_GET_CID_CMD:
-					/* Chip ID = 0x423 */
-					bootloaderStatus |= Bootloader_Get_Chip_ID();
-					break;
-				case CBL_GET_RDP_STATUS_CMD:
-					bootloaderStatus |= Bootloader_Get_RDP_Status();
-					break;
-				case CBL_GO_TO_ADDR_CMD:
-					/* Go to address Function */
-					bootloaderStatus |= Bootloader_GoTo_Address();
-					break;
-				case CBL_GOTO_USER_APP_CMD:
-					bootloaderStatus |= Bootloader_Jump_To_User_App();
-					break;
-				case CBL_FLASH_ERASE_CMD:
-					/* Erase Flash Function */
-					bootloaderStatus |= Bootloader_EraseFlash();
-					break;
-				case CBL_MEM_WRITE_CMD:
-					/* Mmemory Write Function */
-					bootloaderStatus |= Bootloader_writeFlashMemory();
-					break;
-				case CBL_MEM_READ_CMD:
-					/* Memory Read Function */
-					bootloaderStatus |= Bootloader_readFromFlash();
-					break;
-				default: bootloaderStatus |= BL_NOT_OK;
-					break;
-			}
+		BL_Parse_Frame();
+
+		if(baudProbePending && (hostFrame.command != CBL_SET_BAUD_CMD)) {
+			/* Anything but the probe means the switch failed, drop the frame */
+			baudProbePending = 0;
+			HostLink_Set_Baud_Rate(BL_DEFAULT_BAUD_RATE);
+			bootloaderStatus |= BL_NOT_OK;
 		}
 		else {
-			bootloaderStatus |= BL_NOT_OK;	/* Reception is not successfull */
+			bootloaderStatus |= BL_Dispatch_Command();
 		}
-
 	}
 	else {
 		bootloaderStatus |= BL_NOT_OK;	/* Reception is not successfull */
 	}
+
+	/* Hand the frame slot back for the next frames */
+	HostLink_Release_Frame();
+	setStatusLedBusy(0);
 	return bootloaderStatus;
 }
 
+/**
+ * @brief  Sleeps until the next interrupt, unless a frame is already waiting.
+ *         Any reception event, DMA completion or the SysTick wakes the core,
+ *         so the next frame is processed as soon as it is complete.
+ */
+void Bootloader_Wait_For_Event(void)
+{
+#if BL_SLEEP_WHEN_IDLE
+	/* A pending interrupt still ends WFI with the interrupts masked, so a
+	 * frame completing right after the check is not slept through */
+	__disable_irq();
+	if(!HostLink_Frame_Pending()) {
+		__WFI();
+	}
+	__enable_irq();
+#endif
+}
+
 /*---------------  Section: Static Functions Implementation --------------- */
 static BL_ReturnType_t Bootloader_Get_Version(void)
 {
 	uint8_t reply_message[] = { BL_VENDOR_ID, BL_MAJOR_VERSION, BL_MINOR_VERSION,
-								BL_PATCH_VERSION };
-	BL_ReturnType_t Bootloader_State = BL_OK;
-	CRC_State_t CRC_State = CRC_MATCH;
-	HAL_StatusTypeDef UART_State = HAL_OK;
-
-	/* Calculate the CRC For the received messgae */
-	CRC_State = BL_Check_CRC_Matching();
-	if(CRC_State == CRC_NOT_MATCH)
-	{
-		return BL_NOT_OK;
-	}
-	/* Send ACK message */
-	Bootloader_State |= BL_Send_ACK_Message(sizeof(reply_message));
-
-	/* Transmit the Version message */
-	if(Bootloader_State == BL_OK)
-	{
-		UART_State = sendToHost(reply_message, (uint8_t)sizeof(reply_message));
-	}
-
-	if(UART_State == HAL_OK)
-		{ Bootloader_State |= BL_OK; }
-	else
-		{ Bootloader_State |= BL_NOT_OK; }
-
-	return Bootloader_State;
+								BL_PATCH_VERSION,
+								/* Capabilities, little endian. Hosts that
+								 * honour the ACK reply length read past it */
+								(uint8_t)(BL_CAPABILITIES), (uint8_t)(BL_CAPABILITIES >> 8),
+								(uint8_t)(BL_CAPABILITIES >> 16), (uint8_t)(BL_CAPABILITIES >> 24) };
+
+	/* Send ACK message and the Version message in one transfer */
+	return BL_Send_Reply(reply_message, sizeof(reply_message));
 }
 
 static BL_ReturnType_t Bootloader_Get_Help(void)
 {
-	uint8_t reply_message[] = {
-		CBL_GET_VER_CMD,
-		CBL_GET_HELP_CMD,
-		CBL_GET_CID_CMD,
-		CBL_GET_RDP_STATUS_CMD,
-		CBL_GO_TO_ADDR_CMD,
-		CBL_FLASH_ERASE_CMD,
-		CBL_MEM_WRITE_CMD,
-		CBL_ED_W_PROTECT_CMD,
-		CBL_MEM_READ_CMD,
-		CBL_READ_SECTOR_STATUS_CMD,
-		CBL_OTP_READ_CMD,
-		CBL_CHANGE_ROP_Level_CMD
-	};
-	BL_ReturnType_t Bootloader_State = BL_OK;
-	CRC_State_t CRC_State = CRC_MATCH;
-	HAL_StatusTypeDef UART_State = HAL_OK;
+	uint8_t reply_message[BL_COMMAND_COUNT];
+	uint16_t commandCount = 0;
 
-	/* Calculate the CRC For the received messgae */
-	CRC_State = BL_Check_CRC_Matching();
-	if(CRC_State == CRC_NOT_MATCH) {
-		return BL_NOT_OK;
-	}
-	/* Send ACK message */
-	Bootloader_State |= BL_Send_ACK_Message(sizeof(reply_message));
-	HAL_Delay(5);
-
-	/* Transmit the Help message */
-	if(Bootloader_State == BL_OK) {
-		UART_State = sendToHost(reply_message, (uint8_t)sizeof(reply_message));
+	/* Only the commands this build handles */
+	for(uint8_t i = 0; i < BL_COMMAND_COUNT; ++i) {
+		if(commandTable[i].handler != NULL) {
+			reply_message[commandCount++] = commandTable[i].opcode;
+		}
 	}
 
-	if(UART_State == HAL_OK)
-		{ Bootloader_State |= BL_OK; }
-	else
-		{ Bootloader_State |= BL_NOT_OK; }
-
-	return Bootloader_State;
+	/* Send ACK message and the Help message in one transfer */
+	return BL_Send_Reply(reply_message, commandCount);
 }
 
 static BL_ReturnType_t Bootloader_Get_Chip_ID(void) {
-	CRC_State_t CRC_State = CRC_MATCH;
-	BL_ReturnType_t Bootloader_State = BL_OK;
-	HAL_StatusTypeDef UART_State = HAL_OK;
 	uint16_t reply_message = 0;
 
-	/* Get the reply messgage */
+	/* Get the reply messgage, Chip ID = 0x423 */
 	reply_message = DBGMCU->IDCODE & 0xFFF;
 
-	/* Calculate the CRC For the received messgae */
-
-	CRC_State = BL_Check_CRC_Matching();
-	if(CRC_State == CRC_NOT_MATCH)
-	{
-		return BL_NOT_OK;
-	}
-	/* Send ACK message */
-	Bootloader_State |= BL_Send_ACK_Message(sizeof(reply_message));
-	HAL_Delay(5);
-
-	/* Transmit the Chip ID */
-	if(Bootloader_State == BL_OK)
-	{
-		uint8_t Low_Byte  = (uint8_t)(reply_message & 0xFF);
-		uint8_t High_Byte = (uint8_t)(reply_message >> 8);
-		UART_State = sendToHost(&Low_Byte, 1);
-		UART_State = sendToHost(&High_Byte, 1);
-	}
-	if(UART_State == HAL_OK)
-		{ Bootloader_State |= BL_OK; }
-	else
-		{ Bootloader_State |= BL_NOT_OK; }
-
-	return Bootloader_State;
+	/* Send ACK message and the Chip ID (Low Byte first) in one transfer */
+	return BL_Send_Reply(&reply_message, sizeof(reply_message));
 }
 
 static BL_ReturnType_t Bootloader_Get_RDP_Status(void)
 {
-	BL_ReturnType_t Bootloader_State = BL_OK;
-	CRC_State_t CRC_State = CRC_MATCH;
-	HAL_StatusTypeDef UART_State = HAL_OK;
 	uint8_t reply_message = 0;
 
 	/* Get the reply messgage */
@@ -224,27 +332,8 @@ static BL_ReturnType_t Bootloader_Get_RDP_Status(void)
 	HAL_FLASHEx_OBGetConfig(&OB_Config);
 	reply_message = (uint8_t)OB_Config.RDPLevel;
 
-	/* Calculate the CRC For the received message */
-	CRC_State = BL_Check_CRC_Matching();
-	if(CRC_State == CRC_NOT_MATCH)
-	{
-		return BL_NOT_OK;	/* CRC Error */
-	}
-
-	/* Send ACK message */
-	Bootloader_State |= BL_Send_ACK_Message(1);
-
-	/* Transmit the RDP Level */
-	if(Bootloader_State == BL_OK)
-	{
-		UART_State = sendToHost(&reply_message, sizeof(reply_message));
-	}
-	if(UART_State == HAL_OK)
-		{ Bootloader_State |= BL_OK; }
-	else
-		{ Bootloader_State |= BL_NOT_OK; }
-
-	return Bootloader_State;
+	/* Send ACK message and the RDP Level in one transfer */
+	return BL_Send_Reply(&reply_message, sizeof(reply_message));
 }
 
 static BL_ReturnType_t Bootloader_Jump_To_User_App(void)
@@ -252,13 +341,8 @@ static BL_ReturnType_t Bootloader_Jump_To_User_App(void)
 	/* Get Main Stack Pointer */
 	uint32_t MSP_Value = 0;
 	uint32_t newAppResetHandlerAddress = 0;
-	CRC_State_t CRC_State = CRC_MATCH;
 
-	CRC_State = BL_Check_CRC_Matching();
-	if(CRC_State == CRC_MATCH)
-		{ BL_Send_ACK_Message(0); }
-	else
-		{ return BL_NOT_OK; }
+	BL_Send_ACK_Message(0);
 
 #if USER_APPLICATION_SECTOR == FLASH_SECTOR_2
 	MSP_Value = *((volatile uint32_t *)(FLASH_SECTOR_2_BASE_ADD));
@@ -272,10 +356,13 @@ static BL_ReturnType_t Bootloader_Jump_To_User_App(void)
 
 	pToFun newAppResetHandler = (pToFun)newAppResetHandlerAddress;
 
-	/* De-Initialize the running peripherals */
-	HAL_RCC_DeInit();
+	/* Lock the flash, then de-initialize the running peripherals, back to the reset clock */
+	Flash_Session_End();
+	HAL_NVIC_DisableIRQ(FLASH_IRQn);
+	HostLink_DeInit();
+	Clock_Restore_Reset_Profile();
 	HAL_UART_DeInit(BOOTLOADER_UART_OBJECT);
-	HAL_CRC_DeInit(BOOTLOADER_CRC_OBJECT);
+	Crc_DeInit();
 
 	/* Initialize the new MSP */
 	__set_MSP(MSP_Value);
@@ -286,165 +373,1209 @@ static BL_ReturnType_t Bootloader_Jump_To_User_App(void)
 	return BL_OK;
 }
 
+#if BL_ENABLE_GO_TO_ADDR
 /**
  * CRC_MATCH => send ack.
  *
  */
 static BL_ReturnType_t Bootloader_GoTo_Address(void)
 {
-	uint32_t userAddress = *((uint32_t *)(&receivedBuffer[2]));
+	uint32_t userAddress = BL_Get_Payload_Word(0);
 	uint8_t isValidAddress = BL_IsValidAddress(userAddress);
-	CRC_State_t CRC_State = CRC_MATCH;
 
-	CRC_State = BL_Check_CRC_Matching();
-	if(CRC_State == CRC_MATCH) {
-		BL_Send_ACK_Message(0);
-	}
-	else {
-		return BL_NOT_OK;
-	}
+	BL_Send_ACK_Message(0);
 
 	if(isValidAddress) {
+		Flash_Session_End();
+		HAL_NVIC_DisableIRQ(FLASH_IRQn);
 		((pToFun)(userAddress | 0x01UL))();
 	} else {
 		return BL_NOT_OK;
 	}
 	return BL_OK;
 }
+#endif
 
+/**
+ * v1: ACK, then the erase.
+ * v2: the erase, then [Flash Error:32], HAL_FLASH_ERROR_xxx bits (0 => erased),
+ *     and [Skipped Sectors:32], the sectors left alone as they were blank.
+ */
 static BL_ReturnType_t Bootloader_EraseFlash(void) {
-	CRC_State_t CRCState = CRC_MATCH;
-	CRCState = BL_Check_CRC_Matching();
-	if(CRCState == CRC_MATCH) {
+	uint32_t reply_message[2] = { HAL_FLASH_ERROR_NONE, 0 };
+	uint32_t flashError = HAL_FLASH_ERROR_NONE;
+
+	if(hostFrame.version != BL_FRAME_V2) {
 		BL_Send_ACK_Message(0);
+		return Flash_Erase_Mass();
 	}
-	else {
-		return BL_NOT_OK;
+
+	if(Flash_Erase_Mass() != E_OK) {
+		flashError = Flash_Get_Last_Error();
+		if(flashError == HAL_FLASH_ERROR_NONE) {
+			flashError = HAL_FLASH_ERROR_OPERATION;
+		}
 	}
-	return Flash_Erase_Mass();
+	reply_message[0] = flashError;
+	reply_message[1] = Flash_Get_Skipped_Sectors();
+	BL_Send_Reply(reply_message, sizeof(reply_message));
+	return (flashError == HAL_FLASH_ERROR_NONE) ? BL_OK : BL_NOT_OK;
 }
 
 static BL_ReturnType_t Bootloader_writeFlashMemory(void) {
-	CRC_State_t CRCState = CRC_MATCH;
-	uint32_t baseAddress = *((uint32_t *)(&receivedBuffer[2]));
-	uint8_t dataLength = receivedBuffer[0] - 10;
+	uint32_t baseAddress = BL_Get_Payload_Word(0);
+	uint32_t dataLength = 0;
 	BL_ReturnType_t bootloaderStatus = BL_OK;
+	uint8_t writeStatus = 'O';
 
-	CRCState = BL_Check_CRC_Matching();
-	if(CRCState == CRC_MATCH) {
-		BL_Send_ACK_Message(1);
+	if(hostFrame.version == BL_FRAME_V2) {
+		/* v2: [Address:32][Data], the address is little endian */
+		dataLength = hostFrame.payloadLength - 4;
 	}
 	else {
-		BL_Send_NACK_Message();
+		dataLength = (uint8_t)(receivedBuffer[0] - 10);
+	    // Reverse the byte order
+	    baseAddress = convertWordToBigEndian(baseAddress);
 	}
 
-    // Reverse the byte order
-    baseAddress = convertWordToBigEndian(baseAddress);
-
-	uint8_t isValidAddress = ((baseAddress >= FLASH_BASE) && (baseAddress <= FLASH_END));
+	/* The application flash only, word aligned, v2 data is whole words */
+	uint8_t isValidAddress = ((baseAddress >= BL_USER_APP_BASE_ADD) && (baseAddress <= FLASH_END)
+			&& ((baseAddress + dataLength - 1) <= FLASH_END) && ((baseAddress % 4) == 0));
+	if((hostFrame.version == BL_FRAME_V2) && ((dataLength % 4) != 0)) {
+		isValidAddress = 0;
+	}
 	if (!isValidAddress) {
-		sendToHost((uint8_t *) "X", 1);
+		/* The ACK and the status byte leave together once the status is known */
+		writeStatus = 'X';
+		BL_Send_Reply(&writeStatus, 1);
 		return BL_NOT_OK;
 	}
 
-	bootloaderStatus |= flashWrite(baseAddress, (uint8_t *)&receivedBuffer[6], dataLength);
+	if(hostFrame.version == BL_FRAME_V2) {
+		/* Aligned words, programmed as they are laid out in memory */
+		bootloaderStatus |= flashWriteWords(baseAddress, (uint32_t *)&hostFrame.payload[4], dataLength / 4);
+	}
+	else {
+		/* Big endian words, swapped and programmed in one call */
+		bootloaderStatus |= flashWrite(baseAddress, &hostFrame.payload[4], dataLength);
+	}
 
     if(bootloaderStatus) {
-    	sendToHost((uint8_t *) "E", 1);
-    } else {
-    	sendToHost((uint8_t *) "O", 1);
+    	writeStatus = 'E';
     }
+    BL_Send_Reply(&writeStatus, 1);
 	return bootloaderStatus;
 }
 
+#if BL_ENABLE_MEM_READ
 static BL_ReturnType_t Bootloader_readFromFlash(void) {
-	CRC_State_t CRCState = CRC_MATCH;
-	uint32_t baseAddress = *((uint32_t *)(&receivedBuffer[2]));
-	uint8_t dataLength = receivedBuffer[6];
+	uint32_t baseAddress = BL_Get_Payload_Word(0);
+	uint8_t dataLength = hostFrame.payload[4];
 	BL_ReturnType_t bootloaderStatus = BL_OK;
 
-	CRCState = BL_Check_CRC_Matching();
-	if(CRCState == CRC_MATCH) {
-		BL_Send_ACK_Message(dataLength);
-	}
-	else {
-		BL_Send_NACK_Message();
+	if(hostFrame.version == BL_FRAME_V2) {
+		return Bootloader_readFromFlash_V2();
 	}
+
+	BL_Send_ACK_Message(dataLength);
     // Reverse the byte order
     baseAddress = convertWordToBigEndian(baseAddress);
-	uint8_t isValidAddress = ((baseAddress >= FLASH_BASE) && (baseAddress <= FLASH_END)) && (baseAddress % 4 == 0);
+	uint8_t isValidAddress = ((baseAddress >= FLASH_BASE) && (baseAddress <= FLASH_END)) && (baseAddress % 4 == 0)
+			&& ((baseAddress + (dataLength * 4UL) - 1) <= FLASH_END);
 	if (!isValidAddress) {
 		sendToHost((uint8_t *) "E", 1);
 		sendDebuggingMessage((uint8_t *)"Invalid Address", 3);
 		return BL_NOT_OK;
 	}
 
-	for(uint8_t i = 0; i < dataLength; ++i) {
-		uint32_t data = *((volatile uint32_t *)baseAddress);
+	/* The words as laid out in flash, in one transfer */
+	bootloaderStatus |= sendToHost((uint8_t *)baseAddress, dataLength * 4UL);
+	return bootloaderStatus;
+}
+
+/**
+ * v2: [Address:32][Length:32] => the Length bytes as laid out in memory.
+ */
+static BL_ReturnType_t Bootloader_readFromFlash_V2(void) {
+	uint32_t baseAddress = BL_Get_Payload_Word(0);
+	uint32_t dataLength = BL_Get_Payload_Word(4);
+
+	uint8_t isValidAddress = (hostFrame.payloadLength == 8)
+			&& (dataLength > 0) && (dataLength <= BL_FRAME_V2_MAX_DATA_SIZE)
+			&& BL_IsValidAddress(baseAddress) && BL_IsValidAddress(baseAddress + dataLength - 1);
+	if (!isValidAddress) {
+		BL_Send_NACK_Message();
+		return BL_NOT_OK;
+	}
+
+	return BL_Send_Reply((const void *)baseAddress, (uint16_t)dataLength);
+}
+
+/**
+ * [Address:32][Length:32] => [Length:32][Chunk Size:32], then the range as
+ * BL_READ_STREAM_CHUNK_SIZE chunks, each one followed by its CRC:32 (see
+ * Crc_Calculate_Words()). The last chunk may be shorter.
+ *
+ * With an [Encoding] field, every chunk is encoded on its own and sent as
+ * [Encoding:8][0][Stored Length:16][Stored Bytes][CRC:32], the CRC still
+ * being the one of the decoded chunk. A chunk that doesn't shrink goes
+ * COMPRESSION_RAW. Erased flash shrinks to a few bytes per chunk.
+ *
+ * The address and the length are word aligned, the range may cover the
+ * whole flash. The CRC unit checks a chunk by DMA while the previous one is
+ * still on the wire, so the readback runs at the UART speed.
+ */
+static BL_ReturnType_t Bootloader_readFromFlash_Stream(void) {
+	uint32_t baseAddress = BL_Get_Payload_Word(0);
+	uint32_t remaining = BL_Get_Payload_Word(4);
+	uint32_t streamInfo[2] = { remaining, BL_READ_STREAM_CHUNK_SIZE };
+	uint8_t acknowledge_message[4];
+	uint8_t chunkHeader[BL_READ_CHUNK_HEADER_SIZE] = { COMPRESSION_RAW, 0, 0, 0 };
+	uint32_t chunkCRC = 0;
+	uint32_t chunkLength = 0;
+	HAL_StatusTypeDef transmitStatus = HAL_OK;
+	HostLink_Segment_t segments[5] = {
+		{ acknowledge_message, BL_Build_ACK_Header(acknowledge_message, sizeof(streamInfo)) },
+		{ streamInfo, sizeof(streamInfo) },
+		{ chunkHeader, 0 },
+		{ NULL, 0 },
+		{ &chunkCRC, sizeof(chunkCRC) }
+	};
+	HostLink_Segment_t *chunkSegments = segments;
+	uint32_t segmentCount = 5;
+#if BL_ENABLE_COMPRESSED_READ
+	uint8_t encoding = hostFrame.payload[8];
+	uint8_t isEncoded = (hostFrame.payloadLength > 8);
+	uint32_t encodedLength = 0;
+#endif
+
+	uint8_t isValidRequest = (remaining > 0) && ((baseAddress % 4) == 0) && ((remaining % 4) == 0)
+			&& BL_IsValidRange(baseAddress, remaining);
+#if BL_ENABLE_COMPRESSED_READ
+	isValidRequest = isValidRequest && (!isEncoded || (encoding <= COMPRESSION_LZ4));
+	if(isEncoded) {
+		segments[2].length = BL_READ_CHUNK_HEADER_SIZE;
+	}
+#endif
+	if(!isValidRequest) {
+		BL_Send_NACK_Message();
+		return BL_NOT_OK;
+	}
+
+	/* The ACK goes out with the first chunk, then only the chunks */
+	while((remaining > 0) && (transmitStatus == HAL_OK)) {
+		chunkLength = (remaining > BL_READ_STREAM_CHUNK_SIZE) ? BL_READ_STREAM_CHUNK_SIZE : remaining;
+		chunkCRC = Crc_Calculate_Range(baseAddress, chunkLength);
+		segments[3].data = (const void *)baseAddress;
+		segments[3].length = chunkLength;
+
+#if BL_ENABLE_COMPRESSED_READ
+		if(isEncoded) {
+			encodedLength = Compression_Encode(encoding, (const uint8_t *)baseAddress, chunkLength,
+					readEncodeBuffer, chunkLength - 1);
+			chunkHeader[0] = COMPRESSION_RAW;
+			if(encodedLength > 0) {
+				chunkHeader[0] = encoding;
+				segments[3].data = readEncodeBuffer;
+				segments[3].length = encodedLength;
+			}
+			chunkHeader[2] = (uint8_t)segments[3].length;
+			chunkHeader[3] = (uint8_t)(segments[3].length >> 8);
+		}
+#endif
+
+		transmitStatus = HostLink_Transmit(chunkSegments, segmentCount);
+		chunkSegments = &segments[2];
+		segmentCount = 3;
+		baseAddress += chunkLength;
+		remaining -= chunkLength;
+	}
+	return (transmitStatus == HAL_OK) ? BL_OK : BL_NOT_OK;
+}
+#endif
+
+#if BL_ENABLE_PIPELINED_WRITE
+/**
+ * v2: [Window:32] => [Window:32][Receive Ring Size:32]
+ * The granted window is the proposal capped to BL_MAX_WRITE_WINDOW. The host
+ * must also keep the bytes in flight below the receive ring size.
+ * The sequence numbers restart from 0.
+ */
+static BL_ReturnType_t Bootloader_Configure_Window(void) {
+	uint32_t reply_message[2] = { 0, HOST_LINK_RX_RING_SIZE };
+
+	reply_message[0] = WriteWindow_Init(&writeWindow, BL_Get_Payload_Word(0));
+
+	return BL_Send_Reply(reply_message, sizeof(reply_message));
+}
+
+/**
+ * v2: [Sequence:16][Reserved:16][Address:32][Data]
+ *
+ * Up to windowSize frames may be in flight. Each frame carries its own
+ * address, so frames are programmed as soon as they arrive, in any order.
+ * Every frame is answered with a cumulative ACK carrying the next sequence
+ * number still missing. A damaged frame is dropped silently; when a later
+ * frame reveals the gap, one NACK per missing sequence number is sent so
+ * only those frames are resent.
+ *
+ * Replies: [0xDD][CBL_MEM_WRITE_SEQ_CMD][Next Expected Sequence:16]
+ *          [0xEE][CBL_MEM_WRITE_SEQ_CMD][Missing / Failed Sequence:16]
+ */
+static BL_ReturnType_t Bootloader_writeFlashMemory_Seq(void) {
+	uint16_t sequence = 0;
+	uint32_t baseAddress = 0;
+	uint32_t dataLength = 0;
+	uint32_t gaps = 0;
+
+	sequence = *((uint16_t *)&hostFrame.payload[0]);
+	baseAddress = BL_Get_Payload_Word(4);
+	dataLength = hostFrame.payloadLength - 8;
+
+	if(WriteWindow_Classify(&writeWindow, sequence) == WRITE_WINDOW_DUPLICATE) {
+		/* Duplicate or outside the window, only restate the progress */
+		return BL_Send_Sequence_Reply(BL_ACK_MESSAGE, writeWindow.baseSequence);
+	}
+
+	/* The application flash only, a frame aimed elsewhere is NACKed */
+	uint8_t isValidAddress = ((baseAddress >= BL_USER_APP_BASE_ADD) && (baseAddress <= FLASH_END)
+			&& ((baseAddress + dataLength - 1) <= FLASH_END));
+	if (!isValidAddress
+			|| (flashWriteWords(baseAddress, (uint32_t *)&hostFrame.payload[8], dataLength / 4) != HAL_OK)) {
+		BL_Send_Sequence_Reply(BL_NACK_MESSAGE, sequence);
+		return BL_NOT_OK;
+	}
+
+	/* NACK the frames skipped before this one, once each */
+	gaps = WriteWindow_Receive(&writeWindow, sequence);
+	for(uint16_t i = 0; gaps != 0; ++i, gaps >>= 1) {
+		if(gaps & 1UL) {
+			BL_Send_Sequence_Reply(BL_NACK_MESSAGE, (uint16_t)(writeWindow.baseSequence + i));
+		}
+	}
+
+	return BL_Send_Sequence_Reply(BL_ACK_MESSAGE, writeWindow.baseSequence);
+}
+#endif
+
+#if BL_ENABLE_BAUD_SWITCH
+/**
+ * [Baud Rate:32] => [Baud Rate:32], the rate the UART really runs at.
+ *
+ * 1. Proposal, at the current rate: the reply carries the achievable rate,
+ *    then both sides switch.
+ * 2. Probe, at the new rate: the host sends the same command again within
+ *    BL_BAUD_PROBE_TIMEOUT_MS and the reply commits the new rate.
+ * Without a valid probe the link falls back to BL_DEFAULT_BAUD_RATE.
+ */
+static BL_ReturnType_t Bootloader_Set_Baud_Rate(void) {
+	uint32_t requested = BL_Get_Payload_Word(0);
+	uint32_t actual = HostLink_Achievable_Baud_Rate(requested);
+
+	if(actual == 0) {
+		BL_Send_NACK_Message();
+		return BL_NOT_OK;
+	}
+
+	if(BL_Send_Reply(&actual, sizeof(actual)) != BL_OK) {
+		return BL_NOT_OK;
+	}
+
+	if(baudProbePending && (requested == HostLink_Get_Baud_Rate())) {
+		/* Probe received at the new rate, commit it */
+		baudProbePending = 0;
+		return BL_OK;
+	}
+
+	/* The switch waits for the reply to be fully sent, then for the probe */
+	if(HostLink_Set_Baud_Rate(requested) != HAL_OK) {
+		HostLink_Set_Baud_Rate(BL_DEFAULT_BAUD_RATE);
+		return BL_NOT_OK;
+	}
+	baudProbePending = 1;
+	baudProbeStartTick = HAL_GetTick();
+	return BL_OK;
+}
+#endif
+
+#if BL_ENABLE_COMPRESSED_WRITE
+/**
+ * v2: [Address:32][Decoded Length:32][Block Length:16][Encoding:8][Flags:8][Block]
+ *     => 'O' written, 'X' invalid address / length, 'D' corrupt block,
+ *        'E' programming error
+ *
+ * The block is decoded in a streaming stage in front of the flash: the
+ * decoded bytes are staged in BL_DECODE_STAGING_SIZE bytes of RAM and
+ * programmed whenever the staging fills up. The address must be word aligned,
+ * a trailing partial word is padded with 0xFF. With BL_COMPRESSED_LINKED the
+ * block must start where the previous one ended, and its LZ4 matches may
+ * reach back into every block of the chain, read back from the flash.
+ */
+static BL_ReturnType_t Bootloader_writeFlashMemory_Compressed(void) {
+	uint32_t baseAddress = BL_Get_Payload_Word(0);
+	uint32_t decodedLength = BL_Get_Payload_Word(4);
+	uint16_t blockLength = *((uint16_t *)&hostFrame.payload[8]);
+	uint8_t encoding = hostFrame.payload[10];
+	uint8_t flags = hostFrame.payload[11];
+	Compression_Output_t output;
+	uint8_t decodeStatus = COMPRESSION_OK;
+	uint8_t writeStatus = 'O';
+
+	uint8_t isValidRequest = ((baseAddress % 4) == 0) && (baseAddress >= BL_USER_APP_BASE_ADD)
+			&& (decodedLength > 0) && (decodedLength <= BL_MAX_DECODED_BLOCK_SIZE)
+			&& ((baseAddress + decodedLength - 1) <= FLASH_END)
+			&& (blockLength <= (hostFrame.payloadLength - 12))
+			&& (!(flags & BL_COMPRESSED_LINKED) || (baseAddress == compressedStreamEnd));
+	if (!isValidRequest) {
+		writeStatus = 'X';
+		BL_Send_Reply(&writeStatus, 1);
+		return BL_NOT_OK;
+	}
+
+	if(!(flags & BL_COMPRESSED_LINKED)) {
+		compressedStreamStart = baseAddress;
+	}
+	/* Offsets and matches count from the start of the chain */
+	Compression_Output_Init(&output, decodeStaging, sizeof(decodeStaging),
+			(const uint8_t *)compressedStreamStart, decodedLength, BL_Program_Decoded);
+	Compression_Output_Set_History(&output, baseAddress - compressedStreamStart);
+
+	decodeStatus = Compression_Decode(&output, encoding, &hostFrame.payload[12], blockLength);
+	if(decodeStatus == COMPRESSION_OK) {
+		decodeStatus = Compression_Output_Finish(&output);
+	}
+	if((decodeStatus == COMPRESSION_OK)
+			&& (Compression_Output_Length(&output) != (baseAddress - compressedStreamStart + decodedLength))) {
+		decodeStatus = COMPRESSION_CORRUPT;		/* Decoded to less than announced */
+	}
+
+	if(decodeStatus == COMPRESSION_OK) {
+		compressedStreamEnd = baseAddress + decodedLength;
+	}
+	else {
+		/* A broken chain can't be continued */
+		compressedStreamEnd = 0;
+		writeStatus = (decodeStatus == COMPRESSION_SINK_ERROR) ? 'E' : 'D';
+	}
+    BL_Send_Reply(&writeStatus, 1);
+	return (decodeStatus == COMPRESSION_OK) ? BL_OK : BL_NOT_OK;
+}
+
+/**
+ * @brief  Decoder sink, programs the staged bytes at their place in the chain.
+ */
+static uint8_t BL_Program_Decoded(uint32_t offset, const uint8_t *data, uint32_t length)
+{
+	return BL_Program_Bytes(compressedStreamStart + offset, data, length);
+}
+#endif
+
+#if BL_ENABLE_DELTA_UPDATE
+/**
+ * v2: [New Image Length:32][New Image CRC:32] => 'O' ready, 'X' too large
+ *     or the staging sector holds a part of the installed image, 'E' erase error
+ *
+ * Delta update, the new image is assembled in the staging sector from
+ * pieces of the installed image and inserted bytes, then copied over it:
+ *  1. Begin: erases the staging sector, which also drops any older marker.
+ *  2. Patch: appends COPY / INSERT instructions, several frames in a row.
+ *     Each frame holds whole instructions. INSERT data may be raw, RLE or
+ *     LZ4; LZ4 matches may refer to the whole new image built so far.
+ *  3. Commit: checks the new image against its CRC, marks the staging as
+ *     complete, then erases the application sectors and copies it over.
+ *
+ * The installed image is untouched until the staged image is complete and
+ * verified. A commit interrupted by a reset is simply sent again: the marker
+ * survives, the copy restarts from the staging sector. A reset before the
+ * commit needs the delta to start over at Begin.
+ *
+ * The staging sector is only erased while blank or holding a staged image:
+ * an installed image longer than BL_DELTA_MAX_IMAGE_SIZE reaches into it.
+ *
+ * Costs: BL_DECODE_STAGING_SIZE bytes of RAM, the staging sector of flash,
+ * one staging sector erase plus one program of the new image, then the
+ * application erase and copy at the commit.
+ */
+static BL_ReturnType_t Bootloader_Delta_Begin(void) {
+	uint8_t deltaStatus = 'O';
+
+	deltaActive = 0;
+	deltaImage.imageLength = BL_Get_Payload_Word(0);
+	deltaImage.imageCRC = BL_Get_Payload_Word(4);
+
+	if((deltaImage.imageLength == 0) || (deltaImage.imageLength > BL_DELTA_MAX_IMAGE_SIZE)) {
+		deltaStatus = 'X';
+	}
+	else if(!Flash_Get_Blank_Sectors(1UL << BL_DELTA_STAGING_SECTOR)
+			&& !BL_Staged_Image_Valid((const BL_Delta_Marker_t *)BL_DELTA_MARKER_ADD)) {
+		deltaStatus = 'X';
+	}
+	else if(Flash_Erase_Sectors(BL_DELTA_STAGING_SECTOR, 1) != HAL_OK) {
+		deltaStatus = 'E';
+	}
+	else {
+		Compression_Output_Init(&deltaOutput, deltaStaging, sizeof(deltaStaging),
+				(const uint8_t *)BL_DELTA_STAGING_ADD, deltaImage.imageLength, BL_Program_Staged);
+		deltaActive = 1;
+	}
+
+	BL_Send_Reply(&deltaStatus, 1);
+	return (deltaStatus == 'O') ? BL_OK : BL_NOT_OK;
+}
+
+/**
+ * v2: [Instruction]...[BL_DELTA_OP_END padding]
+ *     => 'O' applied, 'X' no delta started, 'D' bad instruction, 'E' program error
+ *
+ * COPY copies from the installed image, offsets are relative to its base.
+ * A failed patch frame aborts the delta.
+ */
+static BL_ReturnType_t Bootloader_Delta_Patch(void) {
+	uint8_t decodeStatus = COMPRESSION_OK;
+	uint8_t deltaStatus = 'O';
+
+	if(!deltaActive) {
+		deltaStatus = 'X';
+		BL_Send_Reply(&deltaStatus, 1);
+		return BL_NOT_OK;
+	}
+
+	decodeStatus = Compression_Apply_Patch(&deltaOutput, (const uint8_t *)BL_USER_APP_BASE_ADD,
+			BL_DELTA_MAX_IMAGE_SIZE, hostFrame.payload, hostFrame.payloadLength);
+
+	if(decodeStatus != COMPRESSION_OK) {
+		deltaActive = 0;
+		deltaStatus = (decodeStatus == COMPRESSION_SINK_ERROR) ? 'E' : 'D';
+	}
+	BL_Send_Reply(&deltaStatus, 1);
+	return (deltaStatus == 'O') ? BL_OK : BL_NOT_OK;
+}
+
+/**
+ * v2: no payload => 'O' installed, 'R' nothing complete staged (restart at
+ *     Begin), 'D' the patches built a different length, 'C' CRC mismatch,
+ *     'E' flash error
+ */
+static BL_ReturnType_t Bootloader_Delta_Commit(void) {
+	const BL_Delta_Marker_t *marker = (const BL_Delta_Marker_t *)BL_DELTA_MARKER_ADD;
+	uint32_t firstSector = Flash_Get_Sector(BL_USER_APP_BASE_ADD);
+	uint32_t lastSector = 0;
+	uint32_t wordCount = 0;
+	uint8_t deltaStatus = 'O';
+
+	if(deltaActive) {
+		/* Seal the staged image first */
+		deltaActive = 0;
+		if(Compression_Output_Finish(&deltaOutput) != COMPRESSION_OK) {
+			deltaStatus = 'E';
+		}
+		else if(Compression_Output_Length(&deltaOutput) != deltaImage.imageLength) {
+			deltaStatus = 'D';
+		}
+		else if(!BL_Staged_Image_Valid(&deltaImage)) {
+			deltaStatus = 'C';
+		}
+		else if(flashWriteWords(BL_DELTA_MARKER_ADD, (const uint32_t *)&deltaImage,
+				sizeof(deltaImage) / 4) != HAL_OK) {
+			deltaStatus = 'E';
+		}
+	}
+	else if(!BL_Staged_Image_Valid(marker)) {
+		deltaStatus = 'R';
+	}
+
+	if(deltaStatus == 'O') {
+		/* From here on the marker is the only record, a reset repeats this part */
+		wordCount = (marker->imageLength + 3) / 4;
+		lastSector = Flash_Get_Sector(BL_USER_APP_BASE_ADD + marker->imageLength - 1);
+
+		if((Flash_Erase_Sectors(firstSector, lastSector - firstSector + 1) != HAL_OK)
+				|| (flashWriteWords(BL_USER_APP_BASE_ADD, (const uint32_t *)BL_DELTA_STAGING_ADD, wordCount) != HAL_OK)) {
+			deltaStatus = 'E';
+		}
+		else if(Crc_Calculate_Range(BL_USER_APP_BASE_ADD, wordCount * 4) != marker->imageCRC) {
+			deltaStatus = 'C';
+		}
+	}
+
+	BL_Send_Reply(&deltaStatus, 1);
+	return (deltaStatus == 'O') ? BL_OK : BL_NOT_OK;
+}
+
+/**
+ * @brief  Patch output sink, programs the staged bytes into the staging sector.
+ */
+static uint8_t BL_Program_Staged(uint32_t offset, const uint8_t *data, uint32_t length)
+{
+	return BL_Program_Bytes(BL_DELTA_STAGING_ADD + offset, data, length);
+}
+
+/**
+ * @brief  Checks the staging sector against an image description.
+ * @retval 1 if the staged image has the given length and CRC.
+ */
+static uint8_t BL_Staged_Image_Valid(const BL_Delta_Marker_t *marker)
+{
+	if((marker->imageLength == 0) || (marker->imageLength > BL_DELTA_MAX_IMAGE_SIZE)) {
+		return 0;	/* Erased or never written */
+	}
+	return (Crc_Calculate_Range(BL_DELTA_STAGING_ADD, (marker->imageLength + 3) & ~3UL)
+			== marker->imageCRC) ? 1 : 0;
+}
+#endif
+
+#if BL_ENABLE_BLOCK_CRC
+/**
+ * [Address:32][Length:32][Block Size:32] => [Block CRC:32] per block
+ *
+ * The range is cut into Block Size blocks, the last one may be shorter.
+ * Each CRC is Crc_Calculate_Words() of the block, as the v2 frames compute
+ * it, done by the CRC unit and the DMA. The host compares the table with its image and
+ * sends only the blocks that differ.
+ * The address, the length and the block size are multiples of 4, the block
+ * size is a power of two of at least BL_MIN_CRC_BLOCK_SIZE. The table must
+ * fit a reply: 63 blocks over v1 frames, 1024 over v2 frames.
+ */
+static BL_ReturnType_t Bootloader_Get_Block_CRC_Table(void) {
+	uint32_t baseAddress = BL_Get_Payload_Word(0);
+	uint32_t length = BL_Get_Payload_Word(4);
+	uint32_t blockSize = BL_Get_Payload_Word(8);
+	uint32_t maxReply = (hostFrame.version == BL_FRAME_V2) ? BL_FRAME_V2_MAX_DATA_SIZE : UINT8_MAX;
+	uint32_t blockCount = 0;
+	uint32_t blockCRCs[BL_CRC_TABLE_CHUNK];
+	uint32_t chunkCount = 0;
+	uint32_t blockLength = 0;
+	BL_ReturnType_t bootloaderStatus = BL_OK;
+
+	if((blockSize >= BL_MIN_CRC_BLOCK_SIZE) && ((blockSize & (blockSize - 1)) == 0)) {
+		blockCount = (length + blockSize - 1) / blockSize;
+	}
+	uint8_t isValidRequest = (blockCount > 0) && ((blockCount * 4) <= maxReply)
+			&& ((baseAddress % 4) == 0) && ((length % 4) == 0)
+			&& BL_IsValidRange(baseAddress, length);
+	if(!isValidRequest) {
+		BL_Send_NACK_Message();
+		return BL_NOT_OK;
+	}
+
+	/* The table goes out in chunks right behind the ACK */
+	bootloaderStatus |= BL_Send_ACK_Message((uint16_t)(blockCount * 4));
 
-		for(uint8_t j = 0; j < 4; ++j) {
-			bootloaderStatus |= sendToHost((uint8_t *)&data, 1);
+	while((blockCount > 0) && (bootloaderStatus == BL_OK)) {
+		chunkCount = (blockCount > BL_CRC_TABLE_CHUNK) ? BL_CRC_TABLE_CHUNK : blockCount;
+
+		for(uint32_t i = 0; i < chunkCount; ++i) {
+			blockLength = (length > blockSize) ? blockSize : length;
+			blockCRCs[i] = Crc_Calculate_Range(baseAddress, blockLength);
+			baseAddress += blockLength;
+			length -= blockLength;
+		}
+		if(sendToHost((uint8_t *)blockCRCs, chunkCount * 4) != HAL_OK) {
+			bootloaderStatus = BL_NOT_OK;
 		}
+		blockCount -= chunkCount;
 	}
 	return bootloaderStatus;
 }
+#endif
+
+#if BL_ENABLE_RANGE_CRC
+/**
+ * [Address:32][Length:32] => [CRC:32]
+ *
+ * Crc_Calculate_Words() of a word aligned flash or SRAM range, streamed
+ * into the CRC unit by DMA. Verifying the whole application costs a few
+ * milliseconds and four bytes of reply instead of a full readback.
+ */
+static BL_ReturnType_t Bootloader_Get_Range_CRC(void) {
+	uint32_t baseAddress = BL_Get_Payload_Word(0);
+	uint32_t length = BL_Get_Payload_Word(4);
+	uint32_t rangeCRC = 0;
+
+	uint8_t isValidRequest = (length > 0) && ((baseAddress % 4) == 0) && ((length % 4) == 0)
+			&& BL_IsValidRange(baseAddress, length);
+	if(!isValidRequest) {
+		BL_Send_NACK_Message();
+		return BL_NOT_OK;
+	}
+
+	rangeCRC = Crc_Calculate_Range(baseAddress, length);
+	return BL_Send_Reply(&rangeCRC, sizeof(rangeCRC));
+}
+#endif
+
+#if BL_ENABLE_SPARSE_WRITE
+/**
+ * v2: [Base Address:32] then extents [Offset:16][Length:16][Data] => 'O',
+ * 'X' (malformed frame or range) or 'E' (programming error)
+ *
+ * The offsets count from the base address, the offsets and the lengths are
+ * multiples of 4, every extent lies above the bootloader sectors. The erased
+ * gaps between the sections of an image are neither sent nor programmed.
+ * The whole frame is checked before the first word is programmed.
+ */
+static BL_ReturnType_t Bootloader_writeFlashMemory_Sparse(void) {
+	uint32_t baseAddress = BL_Get_Payload_Word(0);
+	uint32_t position = 4;
+	uint32_t offset = 0;
+	uint32_t length = 0;
+	uint8_t pass = 0;
+	uint8_t writeStatus = 'O';
+
+	/* Pass 0 validates every extent, pass 1 programs them */
+	for(pass = 0; (pass < 2) && (writeStatus == 'O'); ++pass) {
+		for(position = 4; (position < hostFrame.payloadLength) && (writeStatus == 'O'); position += length) {
+			offset = (uint32_t)hostFrame.payload[position] | ((uint32_t)hostFrame.payload[position + 1] << 8);
+			length = (uint32_t)hostFrame.payload[position + 2] | ((uint32_t)hostFrame.payload[position + 3] << 8);
+			position += BL_SPARSE_EXTENT_HEADER_SIZE;
+
+			if(pass == 0) {
+				if((length == 0) || ((offset % 4) != 0) || ((length % 4) != 0)
+						|| (length > (hostFrame.payloadLength - position))
+						|| ((baseAddress + offset) < BL_USER_APP_BASE_ADD)
+						|| !BL_IsValidRange(baseAddress + offset, length)) {
+					writeStatus = 'X';
+				}
+			}
+			else if(flashWriteWords(baseAddress + offset, (const uint32_t *)&hostFrame.payload[position],
+					length / 4) != HAL_OK) {
+				writeStatus = 'E';
+			}
+		}
+	}
+
+	BL_Send_Reply(&writeStatus, 1);
+	return (writeStatus == 'O') ? BL_OK : BL_NOT_OK;
+}
+#endif
+
+#if BL_ENABLE_ERASE_RANGE
+/**
+ * [Sector Mask:32] or [Address:32][Length:32] => [Sector Mask:32] of the
+ * planned sectors, then one [Sector:8][Status:8][Flash Error:16] progress
+ * record per sector as soon as it is erased, the lowest sector first.
+ * The status is 'O', 'S' (blank already, skipped) or 'E', the erase stops
+ * at the first failure.
+ *
+ * A range erases exactly the sectors it touches, so a small image doesn't
+ * pay for the 128 KB sector. The bootloader sectors are never erased.
+ */
+static BL_ReturnType_t Bootloader_Erase_Range(void) {
+	uint32_t sectorMask = BL_Get_Erase_Plan();
+	uint8_t progress[4] = { 0 };
+	uint32_t flashError = HAL_FLASH_ERROR_NONE;
+	HAL_StatusTypeDef transmitStatus = HAL_OK;
+	HostLink_Segment_t segment = { progress, sizeof(progress) };
+
+	if(sectorMask == 0) {
+		BL_Send_NACK_Message();
+		return BL_NOT_OK;
+	}
+	if(BL_Send_Reply(&sectorMask, sizeof(sectorMask)) != BL_OK) {
+		return BL_NOT_OK;
+	}
+
+	/* A record the host misses would leave it waiting, the erase stops there */
+	for(uint32_t sector = 0; (sector < FLASH_SECTOR_TOTAL) && (flashError == HAL_FLASH_ERROR_NONE)
+			&& (transmitStatus == HAL_OK); ++sector) {
+		if(!(sectorMask & (1UL << sector))) {
+			continue;
+		}
+		if(Flash_Erase_Sectors(sector, 1) != HAL_OK) {
+			flashError = Flash_Get_Last_Error();
+			if(flashError == HAL_FLASH_ERROR_NONE) {
+				flashError = HAL_FLASH_ERROR_OPERATION;
+			}
+		}
+		progress[0] = (uint8_t)sector;
+		progress[1] = (flashError != HAL_FLASH_ERROR_NONE) ? 'E'
+				: ((Flash_Get_Skipped_Sectors() & (1UL << sector)) ? 'S' : 'O');
+		progress[2] = (uint8_t)flashError;
+		progress[3] = (uint8_t)(flashError >> 8);
+		transmitStatus = HostLink_Transmit(&segment, 1);
+	}
+	return ((flashError == HAL_FLASH_ERROR_NONE) && (transmitStatus == HAL_OK)) ? BL_OK : BL_NOT_OK;
+}
+#endif
+
+#if BL_ENABLE_BACKGROUND_ERASE
+/**
+ * [Sector Mask:32] or [Address:32][Length:32] => [Sector Mask:32] started,
+ * [Skipped Sectors:32] of them blank already, reported erased at once,
+ * [Receive Ring Size:32]
+ *
+ * Replies at once, the sectors erase one after the other in the background
+ * and a write waits for the erase of its own sectors only. While a sector
+ * erases the CPU stalls on flash fetches, interrupts included: only the
+ * receive DMA keeps running, into the receive ring. The host must keep the
+ * bytes it sends during an erase within the ring size, the DMA overwrites
+ * older bytes past it without any trace. A write to a sector whose erase
+ * failed is refused with 'E' until the sector is erased again.
+ */
+static BL_ReturnType_t Bootloader_Erase_Start(void) {
+	uint32_t reply_message[3] = { BL_Get_Erase_Plan(), 0, HOST_LINK_RX_RING_SIZE };
+
+	if((reply_message[0] == 0) || (Flash_Erase_Start(reply_message[0]) != HAL_OK)) {
+		BL_Send_NACK_Message();
+		return BL_NOT_OK;
+	}
+	reply_message[1] = Flash_Get_Skipped_Sectors();
+	return BL_Send_Reply(reply_message, sizeof(reply_message));
+}
+
+/**
+ * => [Pending Sectors:32][Erased Sectors:32][Flash Error:32]
+ * A started sector neither pending nor erased failed, the flash error tells why.
+ */
+static BL_ReturnType_t Bootloader_Erase_Status(void) {
+	uint32_t reply_message[3] = { Flash_Erase_Pending(), Flash_Erase_Done(), Flash_Get_Last_Error() };
+
+	return BL_Send_Reply(reply_message, sizeof(reply_message));
+}
+#endif
+
+#if BL_ENABLE_ERASE_RANGE || BL_ENABLE_BACKGROUND_ERASE
+/**
+ * @brief  Reads [Sector Mask:32] or [Address:32][Length:32] into a sector mask.
+ * @retval The sectors to erase, 0 if the request is invalid or reaches the
+ *         bootloader sectors.
+ */
+static uint32_t BL_Get_Erase_Plan(void)
+{
+	uint32_t sectorMask = 0;
+
+	if(hostFrame.payloadLength >= 8) {
+		sectorMask = Flash_Plan_Erase(BL_Get_Payload_Word(0), BL_Get_Payload_Word(4));
+	}
+	else {
+		sectorMask = BL_Get_Payload_Word(0);
+	}
+
+	if((sectorMask & ~FLASH_ALL_SECTORS_MASK) || (sectorMask & BL_PROTECTED_SECTORS_MASK)) {
+		sectorMask = 0;
+	}
+	return sectorMask;
+}
+#endif
+
+#if BL_ENABLE_MEM_FILL
+/**
+ * [Address:32][Length:32][Pattern:32] => 'O', 'X' (invalid range) or 'E'
+ * (programming error, or the range held other data)
+ *
+ * Programs the pattern, as laid out in memory, over a word aligned erased
+ * flash range of the application. Constant regions of an image cost one
+ * frame instead of their whole length on the wire.
+ */
+static BL_ReturnType_t Bootloader_Fill_Memory(void) {
+	uint32_t baseAddress = BL_Get_Payload_Word(0);
+	uint32_t length = BL_Get_Payload_Word(4);
+	uint32_t pattern = BL_Get_Payload_Word(8);
+	uint8_t fillStatus = 'O';
+
+	uint8_t isValidRequest = (length > 0) && ((baseAddress % 4) == 0) && ((length % 4) == 0)
+			&& (baseAddress >= BL_USER_APP_BASE_ADD) && BL_IsValidRange(baseAddress, length);
+	if(!isValidRequest) {
+		fillStatus = 'X';
+		BL_Send_Reply(&fillStatus, 1);
+		return BL_NOT_OK;
+	}
+
+	if(Flash_Fill_Words(baseAddress, pattern, length / 4) != HAL_OK) {
+		fillStatus = 'E';
+	}
+	BL_Send_Reply(&fillStatus, 1);
+	return (fillStatus == 'O') ? BL_OK : BL_NOT_OK;
+}
+#endif
+
+#if BL_ENABLE_MEM_COPY
+/**
+ * [Source:32][Destination:32][Length:32][Flags] => 'O', 'X' (invalid
+ * request), 'E' (flash error) or 'C' (the copy doesn't match the source)
+ *
+ * Copies a word aligned flash or SRAM range into the application flash,
+ * e.g. to promote a staged image. The destination must be erased, or
+ * BL_COPY_ERASE erases every sector it touches, which then must not hold
+ * the source. Both ranges go through the CRC unit to verify the copy.
+ */
+static BL_ReturnType_t Bootloader_Copy_Memory(void) {
+	uint32_t sourceAddress = BL_Get_Payload_Word(0);
+	uint32_t destinationAddress = BL_Get_Payload_Word(4);
+	uint32_t length = BL_Get_Payload_Word(8);
+	uint8_t flags = hostFrame.payload[12];
+	uint32_t firstSector = Flash_Get_Sector(destinationAddress);
+	uint32_t lastSector = Flash_Get_Sector(destinationAddress + length - 1);
+	uint32_t sourceCRC = 0;
+	uint8_t copyStatus = 'O';
+
+	uint8_t isValidRequest = (length > 0) && ((sourceAddress % 4) == 0) && ((destinationAddress % 4) == 0)
+			&& ((length % 4) == 0) && BL_IsValidRange(sourceAddress, length)
+			&& (destinationAddress >= BL_USER_APP_BASE_ADD) && BL_IsValidRange(destinationAddress, length)
+			&& (destinationAddress <= FLASH_END) && ((destinationAddress + length - 1) <= FLASH_END)
+			&& (((sourceAddress + length) <= destinationAddress) || ((destinationAddress + length) <= sourceAddress));
+	if(isValidRequest && (flags & BL_COPY_ERASE)) {
+		/* The erased sectors must leave the source intact */
+		isValidRequest = ((sourceAddress + length) <= Flash_Get_Sector_Base(firstSector))
+				|| (sourceAddress >= Flash_Get_Sector_Base(lastSector + 1));
+	}
+	if(!isValidRequest) {
+		copyStatus = 'X';
+		BL_Send_Reply(&copyStatus, 1);
+		return BL_NOT_OK;
+	}
+
+	sourceCRC = Crc_Calculate_Range(sourceAddress, length);
+
+	if(((flags & BL_COPY_ERASE) && (Flash_Erase_Sectors(firstSector, lastSector - firstSector + 1) != HAL_OK))
+			|| (flashWriteWords(destinationAddress, (const uint32_t *)sourceAddress, length / 4) != HAL_OK)) {
+		copyStatus = 'E';
+	}
+	else if(Crc_Calculate_Range(destinationAddress, length) != sourceCRC) {
+		copyStatus = 'C';
+	}
+
+	BL_Send_Reply(&copyStatus, 1);
+	return (copyStatus == 'O') ? BL_OK : BL_NOT_OK;
+}
+#endif
+
+#if BL_ENABLE_CRC_BENCHMARK
+/**
+ * [Address:32][Length:32] => [Core Clock:32] then [CRC:32][Cycles:32] per
+ * kernel: bitwise, table, slicing by 4, slicing by 8, CRC unit fed by the
+ * CPU and CRC unit fed by DMA.
+ *
+ * Every kernel runs once over the same word aligned range, the host turns
+ * the cycles into MB/s with the core clock and checks the CRCs agree.
+ * Running it on a flash and on an SRAM range shows the wait state cost.
+ */
+static BL_ReturnType_t Bootloader_CRC_Benchmark(void) {
+	static uint32_t (* const softwareKernels[])(uint32_t, const uint32_t *, uint32_t) = {
+		Crc_Bitwise_Words, Crc_Table_Words, Crc_Slice4_Words, Crc_Slice8_Words
+	};
+	uint32_t baseAddress = BL_Get_Payload_Word(0);
+	uint32_t length = BL_Get_Payload_Word(4);
+	uint32_t reply[1 + 2 * ((sizeof(softwareKernels) / sizeof(softwareKernels[0])) + 2)];
+	uint32_t *entry = &reply[1];
+	uint32_t startCycles = 0;
+
+	uint8_t isValidRequest = (length > 0) && ((baseAddress % 4) == 0) && ((length % 4) == 0)
+			&& BL_IsValidRange(baseAddress, length);
+	if(!isValidRequest) {
+		BL_Send_NACK_Message();
+		return BL_NOT_OK;
+	}
+
+	BL_Start_Cycle_Counter();
+	reply[0] = HAL_RCC_GetHCLKFreq();
+
+	for(uint8_t i = 0; i < (sizeof(softwareKernels) / sizeof(softwareKernels[0])); ++i) {
+		startCycles = DWT->CYCCNT;
+		entry[0] = softwareKernels[i](CRC_SOFTWARE_INIT, (const uint32_t *)baseAddress, length / 4);
+		entry[1] = DWT->CYCCNT - startCycles;
+		entry += 2;
+	}
+
+	startCycles = DWT->CYCCNT;
+	entry[0] = Crc_Calculate_Words((const uint32_t *)baseAddress, length / 4);
+	entry[1] = DWT->CYCCNT - startCycles;
+	entry += 2;
+
+	startCycles = DWT->CYCCNT;
+	entry[0] = Crc_Calculate_Range(baseAddress, length);
+	entry[1] = DWT->CYCCNT - startCycles;
+
+	return BL_Send_Reply(reply, sizeof(reply));
+}
+#endif
+
+#if BL_ENABLE_COMPRESSED_WRITE || BL_ENABLE_DELTA_UPDATE
+/**
+ * @brief  Programs word aligned bytes, a trailing partial word is padded with 0xFF.
+ * @retval 0 on success, 1 on a programming error.
+ */
+static uint8_t BL_Program_Bytes(uint32_t address, const uint8_t *data, uint32_t length)
+{
+	uint32_t lastWord = 0xFFFFFFFF;
+
+	/* The staging buffers are word aligned and only the tail is a partial word */
+	if(flashWriteWords(address, (const uint32_t *)data, length / 4) != HAL_OK) {
+		return 1;
+	}
+	if(length % 4) {
+		memcpy(&lastWord, &data[length & ~3UL], length % 4);
+		if(flashWriteWords(address + (length & ~3UL), &lastWord, 1) != HAL_OK) {
+			return 1;
+		}
+	}
+	return 0;
+}
+#endif
+
+#if BL_ENABLE_COMMAND_STATS
+/**
+ * [Command:8] => BL_Command_Stats_t of that command, little endian.
+ * The cycles are core clock cycles spent from the dispatch to the return of
+ * the handler, validation and CRC check included.
+ */
+static BL_ReturnType_t Bootloader_Get_Stats(void) {
+	const BL_Command_t *command = BL_Find_Command(hostFrame.payload[0]);
 
+	if(command == NULL) {
+		BL_Send_NACK_Message();
+		return BL_NOT_OK;
+	}
+	return BL_Send_Reply(&commandStats[command->opcode - BL_FIRST_COMMAND], sizeof(BL_Command_Stats_t));
+}
+#endif
 
 /* --------------------------------------------------------------------- */
-static BL_ReturnType_t BL_Send_ACK_Message(uint8_t Reply_Lenght)
+/**
+ * v1 ACK: [0xDD][Reply Length:8]
+ * v2 ACK: [0xDD][Command][Reply Length:16]
+ */
+static uint32_t BL_Build_ACK_Header(uint8_t *Header, uint16_t Reply_Lenght)
+{
+	Header[0] = BL_ACK_MESSAGE;
+
+	if(hostFrame.version == BL_FRAME_V2) {
+		Header[1] = hostFrame.command;
+		Header[2] = (uint8_t)Reply_Lenght;
+		Header[3] = (uint8_t)(Reply_Lenght >> 8);
+		return 4;
+	}
+	Header[1] = (uint8_t)Reply_Lenght;
+	return 2;
+}
+
+/**
+ * Sends the ACK alone, the announced reply follows separately.
+ */
+static BL_ReturnType_t BL_Send_ACK_Message(uint16_t Reply_Lenght)
 {
 	HAL_StatusTypeDef UART_State = HAL_OK;
-	uint8_t acknowledge_message[2] = { BL_ACK_MESSAGE, Reply_Lenght };
+	uint8_t acknowledge_message[4];
+	uint32_t headerLength = BL_Build_ACK_Header(acknowledge_message, Reply_Lenght);
 
 	/* Transmit the acknowledge message over UART */
-	UART_State = HAL_UART_Transmit(BOOTLOADER_UART_OBJECT, acknowledge_message,
-			2, HAL_MAX_DELAY);
+	UART_State = sendToHost(acknowledge_message, headerLength);
 
 	return (UART_State == HAL_OK) ? BL_OK : BL_NOT_OK;
 }
 
+/**
+ * Sends the ACK and the reply as a single DMA burst.
+ */
+static BL_ReturnType_t BL_Send_Reply(const void *Reply, uint16_t Reply_Lenght)
+{
+	uint8_t acknowledge_message[4];
+	HostLink_Segment_t segments[2] = {
+		{ acknowledge_message, BL_Build_ACK_Header(acknowledge_message, Reply_Lenght) },
+		{ Reply, Reply_Lenght }
+	};
+
+	return (HostLink_Transmit(segments, 2) == HAL_OK) ? BL_OK : BL_NOT_OK;
+}
+
+/**
+ * v1 NACK: [0xEE]
+ * v2 NACK: [0xEE][Command][0:16]
+ */
 static BL_ReturnType_t BL_Send_NACK_Message()
 {
 	HAL_StatusTypeDef UART_State = HAL_OK;
-	uint8_t acknowledge_message[1] = { BL_NACK_MESSAGE };
+	uint8_t acknowledge_message[4] = { BL_NACK_MESSAGE, hostFrame.command, 0, 0 };
 
 	/* Transmit the acknowledge message over UART */
-	UART_State = HAL_UART_Transmit(BOOTLOADER_UART_OBJECT, acknowledge_message,
-			1, HAL_MAX_DELAY);
+	UART_State = sendToHost(acknowledge_message, (hostFrame.version == BL_FRAME_V2) ? 4 : 1);
 
 	return (UART_State == HAL_OK) ? BL_OK : BL_NOT_OK;
 }
-uint32_t calculateCRC32(const uint8_t* buffer, uint8_t bufferLength) {
-  uint32_t CRC_Value = 0xFFFFFFFF;
-
-  for (uint8_t i = 0; i < bufferLength; ++i) {
-    CRC_Value ^= buffer[i];
-
-    for (int DataElemBitLen = 0; DataElemBitLen < 32; ++DataElemBitLen) {  // 8 bits per byte
-      if (CRC_Value & 0x80000000) {
-        CRC_Value = (CRC_Value << 1) ^ 0x04C11DB7;
-      } else {
-        CRC_Value = (CRC_Value << 1);
-      }
-    }
+#if BL_ENABLE_PIPELINED_WRITE
+/**
+ * [Reply][Command][Sequence:16], used by the pipelined write protocol
+ */
+static BL_ReturnType_t BL_Send_Sequence_Reply(uint8_t Reply, uint16_t Sequence)
+{
+	uint8_t reply_message[4] = { Reply, hostFrame.command, (uint8_t)Sequence, (uint8_t)(Sequence >> 8) };
 
-  }
-  return convertWordToBigEndian((uint32_t)(CRC_Value & 0xFFFFFFFF));
+	return (sendToHost(reply_message, sizeof(reply_message)) == HAL_OK) ? BL_OK : BL_NOT_OK;
 }
+#endif
 static CRC_State_t BL_Check_CRC_Matching(void)
 {
 	uint32_t crcResult = 0xFFFFFFFF;
 	uint32_t hostCRC = 0;
-	uint8_t packetLen = receivedBuffer[0] + 1;
-	/* Get the received CRC */
-	hostCRC = *((uint32_t *)((receivedBuffer + packetLen) - 4));
-	crcResult = calculateCRC32(receivedBuffer, packetLen - 4);
+	uint32_t packetLen = 0;
+
+	if(hostFrame.version == BL_FRAME_V2)
+	{
+		/* Header and payload are whole words, the CRC follows little endian */
+		packetLen = HOST_LINK_FRAME_V2_HEADER_SIZE + hostFrame.payloadLength;
+		hostCRC = *((uint32_t *)(receivedBuffer + packetLen));
+		crcResult = Crc_Calculate_Words((const uint32_t *)receivedBuffer, packetLen / 4);
+	}
+	else
+	{
+		packetLen = receivedBuffer[0] + 1;
+		if(packetLen < (2 + HOST_LINK_FRAME_CRC_SIZE)) {
+			return CRC_NOT_MATCH;	/* Too short to carry a command and a CRC */
+		}
+		/* Get the received CRC, big endian */
+		hostCRC = ((uint32_t)receivedBuffer[packetLen - 4] << 24) | ((uint32_t)receivedBuffer[packetLen - 3] << 16)
+				| ((uint32_t)receivedBuffer[packetLen - 2] << 8) | (uint32_t)receivedBuffer[packetLen - 1];
+		crcResult = Crc_Calculate_Bytes(receivedBuffer, packetLen - 4);
+	}
 	return (hostCRC == crcResult) ? CRC_MATCH : CRC_NOT_MATCH;
 }
 
+/**
+ * @brief  Runs the handler of the received command from the command table.
+ *         The frame version, the payload length and the CRC are validated
+ *         here, so the handlers only deal with the payload fields.
+ *         Unknown and stripped commands are ignored.
+ */
+static BL_ReturnType_t BL_Dispatch_Command(void)
+{
+	const BL_Command_t *command = BL_Find_Command(hostFrame.command);
+	BL_ReturnType_t bootloaderStatus = BL_NOT_OK;
+#if BL_ENABLE_COMMAND_STATS
+	uint32_t startCycles = 0;
+	uint32_t elapsedCycles = 0;
+
+	/* The cycle counter runs from the first command on */
+	BL_Start_Cycle_Counter();
+	startCycles = DWT->CYCCNT;
+#endif
+
+	if(command == NULL) {
+		return BL_NOT_OK;
+	}
+
+	if(!(command->frames & hostFrame.version)
+			|| (hostFrame.payloadLength < command->minPayload)
+			|| (hostFrame.payloadLength > command->maxPayload)) {
+		BL_Send_NACK_Message();
+	}
+	else if(BL_Check_CRC_Matching() == CRC_NOT_MATCH) {
+		if(command->crcPolicy == BL_CRC_NACK) {
+			BL_Send_NACK_Message();
+		}
+	}
+	else {
+		bootloaderStatus = command->handler();
+	}
+
+#if BL_ENABLE_COMMAND_STATS
+	BL_Command_Stats_t *stats = &commandStats[command->opcode - BL_FIRST_COMMAND];
+	elapsedCycles = DWT->CYCCNT - startCycles;
+	stats->calls++;
+	stats->totalCycles += elapsedCycles;
+	if(elapsedCycles > stats->maxCycles) {
+		stats->maxCycles = elapsedCycles;
+	}
+	if(bootloaderStatus != BL_OK) {
+		stats->failures++;
+	}
+#endif
+	return bootloaderStatus;
+}
+
+/**
+ * @brief  Looks the opcode up in the command table.
+ * @retval The table entry, NULL if the opcode isn't handled by this build.
+ */
+static const BL_Command_t *BL_Find_Command(uint8_t opcode)
+{
+	const BL_Command_t *command = NULL;
+
+	if((opcode >= BL_FIRST_COMMAND) && (opcode <= BL_LAST_COMMAND)) {
+		command = &commandTable[opcode - BL_FIRST_COMMAND];
+	}
+	return ((command != NULL) && (command->handler != NULL)) ? command : NULL;
+}
+
+/**
+ * @brief  Falls back to the default baud rate when the probe is late.
+ */
+static void BL_Check_Baud_Probe(void)
+{
+	if(baudProbePending && ((HAL_GetTick() - baudProbeStartTick) > BL_BAUD_PROBE_TIMEOUT_MS)) {
+		baudProbePending = 0;
+		HostLink_Set_Baud_Rate(BL_DEFAULT_BAUD_RATE);
+	}
+}
+
+/**
+ * @brief  Fills hostFrame from the frame in receivedBuffer.
+ */
+static void BL_Parse_Frame(void)
+{
+	hostFrame.command = receivedBuffer[1];
+
+	if(receivedBuffer[0] == HOST_LINK_FRAME_V2_MARKER)
+	{
+		hostFrame.version = BL_FRAME_V2;
+		hostFrame.payloadLength = *((uint16_t *)&receivedBuffer[2]);
+		hostFrame.payload = &receivedBuffer[HOST_LINK_FRAME_V2_HEADER_SIZE];
+	}
+	else
+	{
+		/* v1: The length byte counts the command, the payload and the CRC */
+		hostFrame.version = BL_FRAME_V1;
+		hostFrame.payloadLength = (receivedBuffer[0] > 5) ? (receivedBuffer[0] - 5) : 0;
+		hostFrame.payload = &receivedBuffer[2];
+	}
+}
+
+/**
+ * @brief  Reads a little endian word from the payload.
+ *         v2 fields are naturally aligned, v1 fields may not be.
+ */
+static uint32_t BL_Get_Payload_Word(uint16_t offset)
+{
+	uint32_t word = 0;
+
+	if(hostFrame.version == BL_FRAME_V2) {
+		word = *((uint32_t *)&hostFrame.payload[offset]);
+	}
+	else {
+		memcpy(&word, &hostFrame.payload[offset], sizeof(word));
+	}
+	return word;
+}
+
+/**
+ * @brief  Checks that a non empty range lies entirely in the SRAM or in the FLASH.
+ */
+static inline uint8_t BL_IsValidRange(uint32_t address, uint32_t length)
+{
+	uint32_t lastAddress = address + length - 1;
+
+	return (length > 0) && (lastAddress >= address)
+			&& BL_IsValidAddress(address) && BL_IsValidAddress(lastAddress)
+			&& ((address >= FLASH_BASE) == (lastAddress >= FLASH_BASE))
+			&& ((address >= SRAM1_BASE) == (lastAddress >= SRAM1_BASE));
+}
+
 static inline uint8_t BL_IsValidAddress(uint32_t userAddress)
 {
 	//	Address is valid only if it's within the SRAM or the FLASH memories
 	return (((userAddress >= SRAM1_BASE) && (userAddress <= 0x2000FFFF))
 			|| ((userAddress >= FLASH_BASE) && (userAddress <= FLASH_END)));
 }
+
+#if BL_ENABLE_COMMAND_STATS || BL_ENABLE_CRC_BENCHMARK
+/**
+ * @brief  Starts the DWT cycle counter once, it then keeps running.
+ */
+static inline void BL_Start_Cycle_Counter(void)
+{
+	if(!(DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk)) {
+		CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+		DWT->CYCCNT = 0;
+		DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+	}
+}
+#endif
@@ -0,0 +1,105 @@
+/**
+ ******************************************************************************
+ * @file           : clockServices.c
+ * @author         : Mostafa Asaad (https://github.com/M0stafa077)
+ * @brief          : System clock profiles implementation.
+ *                   The bootloader boots on the 16 MHz HSI and switches to the
+ *                   configured profile once a host session starts, so both the
+ *                   UART baud rates and the CPU bound stages (checksums,
+ *                   compares) scale with the faster clock.
+ ******************************************************************************
+ */
+
+/*---------------  Section: Includes --------------- */
+
+#include "clockServices/clockServices.h"
+
+/* --------------- Section: Private Macros Declarations --------------- */
+
+/* !< 84 MHz: VCO = 336 MHz, SYSCLK = VCO / 4, 48 MHz domain = VCO / 7 */
+#define CLOCK_PLL_N						336U
+#define CLOCK_PLL_P						RCC_PLLP_DIV4
+#define CLOCK_PLL_Q						7U
+
+/* !< 1 MHz PLL input */
+#define CLOCK_PLL_M_HSI					(HSI_VALUE / 1000000U)
+#define CLOCK_PLL_M_HSE					(HSE_VALUE / 1000000U)
+
+/* !< 60 MHz < HCLK <= 84 MHz at 2.7 V - 3.6 V */
+#define CLOCK_84MHZ_FLASH_LATENCY		FLASH_LATENCY_2
+
+/*---------------  Section: Functions Definition --------------- */
+
+/**
+ * @brief  Switches to the BL_CLOCK_PROFILE clock.
+ *         The flash wait states are raised before the clock, prefetch and
+ *         caches are enabled, and the SysTick is re-timed by the HAL.
+ *         Peripherals clocked from the APB buses (the UART baud rate) must be
+ *         reconfigured afterwards.
+ * @retval HAL_StatusTypeDef: Status of the switch, the clock is unchanged on error.
+ */
+HAL_StatusTypeDef Clock_Enter_Session_Profile(void)
+{
+#if (BL_CLOCK_PROFILE == BL_CLOCK_PROFILE_HSI_16MHZ)
+	return HAL_OK;
+#else
+	RCC_OscInitTypeDef RCC_OscInitStruct = {0};
+	RCC_ClkInitTypeDef RCC_ClkInitStruct = {0};
+
+#if (BL_CLOCK_PROFILE == BL_CLOCK_PROFILE_HSE_PLL_84MHZ)
+	RCC_OscInitStruct.OscillatorType = RCC_OSCILLATORTYPE_HSE;
+	RCC_OscInitStruct.HSEState = RCC_HSE_ON;
+	RCC_OscInitStruct.PLL.PLLSource = RCC_PLLSOURCE_HSE;
+	RCC_OscInitStruct.PLL.PLLM = CLOCK_PLL_M_HSE;
+#else
+	RCC_OscInitStruct.OscillatorType = RCC_OSCILLATORTYPE_HSI;
+	RCC_OscInitStruct.HSIState = RCC_HSI_ON;
+	RCC_OscInitStruct.HSICalibrationValue = RCC_HSICALIBRATION_DEFAULT;
+	RCC_OscInitStruct.PLL.PLLSource = RCC_PLLSOURCE_HSI;
+	RCC_OscInitStruct.PLL.PLLM = CLOCK_PLL_M_HSI;
+#endif
+	RCC_OscInitStruct.PLL.PLLState = RCC_PLL_ON;
+	RCC_OscInitStruct.PLL.PLLN = CLOCK_PLL_N;
+	RCC_OscInitStruct.PLL.PLLP = CLOCK_PLL_P;
+	RCC_OscInitStruct.PLL.PLLQ = CLOCK_PLL_Q;
+	if (HAL_RCC_OscConfig(&RCC_OscInitStruct) != HAL_OK)
+	{
+		return HAL_ERROR;
+	}
+
+	/* APB1 is limited to 42 MHz */
+	RCC_ClkInitStruct.ClockType = RCC_CLOCKTYPE_HCLK|RCC_CLOCKTYPE_SYSCLK
+								|RCC_CLOCKTYPE_PCLK1|RCC_CLOCKTYPE_PCLK2;
+	RCC_ClkInitStruct.SYSCLKSource = RCC_SYSCLKSOURCE_PLLCLK;
+	RCC_ClkInitStruct.AHBCLKDivider = RCC_SYSCLK_DIV1;
+	RCC_ClkInitStruct.APB1CLKDivider = RCC_HCLK_DIV2;
+	RCC_ClkInitStruct.APB2CLKDivider = RCC_HCLK_DIV1;
+
+	/* Raises the wait states before switching SYSCLK */
+	if (HAL_RCC_ClockConfig(&RCC_ClkInitStruct, CLOCK_84MHZ_FLASH_LATENCY) != HAL_OK)
+	{
+		return HAL_ERROR;
+	}
+
+	__HAL_FLASH_PREFETCH_BUFFER_ENABLE();
+	__HAL_FLASH_INSTRUCTION_CACHE_ENABLE();
+	__HAL_FLASH_DATA_CACHE_ENABLE();
+
+	return HAL_OK;
+#endif
+}
+
+/**
+ * @brief  Returns to the reset clock (HSI 16 MHz, PLL off, zero wait states),
+ *         so the user application starts from the state it expects.
+ * @retval HAL_StatusTypeDef: Status of the switch.
+ */
+HAL_StatusTypeDef Clock_Restore_Reset_Profile(void)
+{
+	HAL_StatusTypeDef status = HAL_RCC_DeInit();
+
+	/* SYSCLK runs from the HSI now, the wait states can be dropped */
+	__HAL_FLASH_SET_LATENCY(FLASH_LATENCY_0);
+
+	return status;
+}
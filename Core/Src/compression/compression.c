@@ -0,0 +1,536 @@
+/**
+ ******************************************************************************
+ * @file           : compression.c
+ * @author         : Mostafa Asaad (https://github.com/M0stafa077)
+ * @brief          : Streaming block decoder and block encoder implementation
+ ******************************************************************************
+ */
+
+/*---------------  Section: Includes --------------- */
+
+#include <string.h>
+#include "compression/compression.h"
+
+/*---------------  Section: Private Macros Declarations --------------- */
+
+/* !< LZ4 block rules: the last match starts 12 bytes before the end at the
+ *    latest, and the last 5 bytes are literals */
+#define COMPRESSION_LZ4_MATCH_LIMIT		12U
+#define COMPRESSION_LZ4_LAST_LITERALS	5U
+#define COMPRESSION_LZ4_MIN_MATCH		4U
+
+#define COMPRESSION_LZ4_HASH(sequence)	((uint32_t)((sequence) * 2654435761U) >> (32U - COMPRESSION_LZ4_HASH_BITS))
+
+/*---------------  Section: Global Variables --------------- */
+
+/* !< Last position + 1 of every hashed 4 byte sequence, 0 when none */
+static uint16_t lz4HashTable[1U << COMPRESSION_LZ4_HASH_BITS];
+
+/*---------------  Section: Static Functions Declaration --------------- */
+
+static uint8_t Compression_Put(Compression_Output_t *output, const uint8_t *data, uint32_t length);
+static uint8_t Compression_Repeat(Compression_Output_t *output, uint8_t value, uint32_t count);
+static uint8_t Compression_Copy_Match(Compression_Output_t *output, uint32_t offset, uint32_t length);
+static uint8_t Compression_Decode_RLE(Compression_Output_t *output, const uint8_t *input, uint32_t inputLength);
+static uint8_t Compression_Decode_LZ4(Compression_Output_t *output, const uint8_t *input, uint32_t inputLength);
+static uint8_t Compression_Read_Length(const uint8_t **input, const uint8_t *end, uint32_t *length);
+static uint32_t Compression_Encode_RLE(const uint8_t *input, uint32_t inputLength, uint8_t *output, uint32_t outputSize);
+static uint32_t Compression_Encode_LZ4(const uint8_t *input, uint32_t inputLength, uint8_t *output, uint32_t outputSize);
+static uint32_t Compression_Put_Literals(uint8_t *output, uint32_t outputSize, uint32_t position,
+		const uint8_t *literals, uint32_t length);
+static uint32_t Compression_Put_Sequence(uint8_t *output, uint32_t outputSize, uint32_t position,
+		const uint8_t *literals, uint32_t literalLength, uint32_t offset, uint32_t matchLength);
+static uint32_t Compression_Put_Length(uint8_t *output, uint32_t outputSize, uint32_t position, uint32_t length);
+
+/*---------------  Section: Functions Definition --------------- */
+
+/**
+ * @brief  Prepares an empty output stream.
+ * @param  output: The output object.
+ * @param  staging: Staging buffer, word aligned.
+ * @param  stagingSize: Staging buffer size, a multiple of 4.
+ * @param  flushed: Where the flushed output can be read back, NULL if the
+ *         sink isn't readable. LZ matches are then limited to the staging.
+ * @param  limit: The most bytes the stream may decode to.
+ * @param  sink: Receives the decoded bytes.
+ */
+void Compression_Output_Init(Compression_Output_t *output, uint8_t *staging, uint32_t stagingSize,
+		const uint8_t *flushed, uint32_t limit, Compression_Sink_t sink)
+{
+	output->staging = staging;
+	output->stagingSize = stagingSize;
+	output->stagingFill = 0;
+	output->flushed = flushed;
+	output->flushedLength = 0;
+	output->limit = limit;
+	output->sink = sink;
+}
+
+/**
+ * @brief  Continues an earlier stream: its historyLength bytes are already
+ *         flushed and readable, so the next matches may refer to them. The
+ *         sink offsets and the limit then count from the start of the history.
+ *         Call it right after Compression_Output_Init().
+ * @param  output: The output stream.
+ * @param  historyLength: Bytes of earlier output, a multiple of 4.
+ */
+void Compression_Output_Set_History(Compression_Output_t *output, uint32_t historyLength)
+{
+	output->flushedLength = historyLength;
+	output->limit += historyLength;
+}
+
+/**
+ * @brief  Decodes one block and appends it to the output stream.
+ *         LZ4 matches may refer to the earlier blocks of the same stream.
+ * @param  output: The output stream.
+ * @param  encoding: COMPRESSION_RAW, COMPRESSION_RLE or COMPRESSION_LZ4.
+ * @param  input: The encoded block.
+ * @param  inputLength: The encoded block length in bytes.
+ * @retval COMPRESSION_OK, or the first error met.
+ */
+uint8_t Compression_Decode(Compression_Output_t *output, uint8_t encoding,
+		const uint8_t *input, uint32_t inputLength)
+{
+	uint8_t status = COMPRESSION_CORRUPT;
+
+	switch(encoding) {
+		case COMPRESSION_RAW:
+			status = Compression_Put(output, input, inputLength);
+			break;
+		case COMPRESSION_RLE:
+			status = Compression_Decode_RLE(output, input, inputLength);
+			break;
+		case COMPRESSION_LZ4:
+			status = Compression_Decode_LZ4(output, input, inputLength);
+			break;
+		default:
+			break;
+	}
+	return status;
+}
+
+/**
+ * @brief  Applies whole patch instructions, multi byte fields little endian:
+ *         COPY appends a piece of the source, INSERT decodes a block.
+ * @param  output: The output stream.
+ * @param  source: The image the COPY offsets refer to.
+ * @param  sourceLength: The bytes of the source COPY may read.
+ * @param  patch: The instructions, up to the end or to COMPRESSION_PATCH_END.
+ * @param  patchLength: The patch length in bytes.
+ * @retval COMPRESSION_OK, or the first error met. A truncated instruction
+ *         or a COPY outside the source is COMPRESSION_CORRUPT.
+ */
+uint8_t Compression_Apply_Patch(Compression_Output_t *output, const uint8_t *source, uint32_t sourceLength,
+		const uint8_t *patch, uint32_t patchLength)
+{
+	const uint8_t *end = patch + patchLength;
+	uint32_t offset = 0;
+	uint32_t length = 0;
+	uint16_t insertLength = 0;
+	uint8_t status = COMPRESSION_OK;
+
+	while((patch < end) && (*patch != COMPRESSION_PATCH_END) && (status == COMPRESSION_OK)) {
+		if((*patch == COMPRESSION_PATCH_COPY) && ((end - patch) >= 9)) {
+			memcpy(&offset, &patch[1], sizeof(offset));
+			memcpy(&length, &patch[5], sizeof(length));
+			patch += 9;
+
+			if((offset > sourceLength) || (length > (sourceLength - offset))) {
+				status = COMPRESSION_CORRUPT;
+			}
+			else {
+				status = Compression_Decode(output, COMPRESSION_RAW, &source[offset], length);
+			}
+		}
+		else if((*patch == COMPRESSION_PATCH_INSERT) && ((end - patch) >= 4)) {
+			memcpy(&insertLength, &patch[2], sizeof(insertLength));
+			if(insertLength > (end - patch - 4)) {
+				status = COMPRESSION_CORRUPT;
+			}
+			else {
+				status = Compression_Decode(output, patch[1], &patch[4], insertLength);
+				patch += 4 + insertLength;
+			}
+		}
+		else {
+			status = COMPRESSION_CORRUPT;
+		}
+	}
+	return status;
+}
+
+/**
+ * @brief  Hands the last, partly filled, staging buffer to the sink.
+ * @retval COMPRESSION_OK or COMPRESSION_SINK_ERROR.
+ */
+uint8_t Compression_Output_Finish(Compression_Output_t *output)
+{
+	if(output->stagingFill > 0) {
+		if(output->sink(output->flushedLength, output->staging, output->stagingFill) != 0) {
+			return COMPRESSION_SINK_ERROR;
+		}
+		output->flushedLength += output->stagingFill;
+		output->stagingFill = 0;
+	}
+	return COMPRESSION_OK;
+}
+
+/**
+ * @brief  Returns the number of bytes decoded so far.
+ */
+uint32_t Compression_Output_Length(const Compression_Output_t *output)
+{
+	return output->flushedLength + output->stagingFill;
+}
+
+/**
+ * @brief  Encodes one standalone block.
+ * @param  encoding: COMPRESSION_RLE, or COMPRESSION_LZ4 for blocks up to
+ *         COMPRESSION_LZ4_MAX_BLOCK bytes.
+ * @param  input: The block.
+ * @param  inputLength: The block length in bytes.
+ * @param  output: Receives the encoded block.
+ * @param  outputSize: The most bytes the encoded block may take.
+ * @retval The encoded length, 0 if it doesn't fit in the output (the block
+ *         is then better sent raw) or the encoding isn't supported.
+ */
+uint32_t Compression_Encode(uint8_t encoding, const uint8_t *input, uint32_t inputLength,
+		uint8_t *output, uint32_t outputSize)
+{
+	uint32_t encodedLength = 0;
+
+	switch(encoding) {
+		case COMPRESSION_RLE:
+			encodedLength = Compression_Encode_RLE(input, inputLength, output, outputSize);
+			break;
+		case COMPRESSION_LZ4:
+			if(inputLength <= COMPRESSION_LZ4_MAX_BLOCK) {
+				encodedLength = Compression_Encode_LZ4(input, inputLength, output, outputSize);
+			}
+			break;
+		default:
+			break;
+	}
+	return encodedLength;
+}
+
+/*---------------  Section: Static Functions Definition --------------- */
+
+static uint8_t Compression_Put(Compression_Output_t *output, const uint8_t *data, uint32_t length)
+{
+	uint32_t chunk = 0;
+
+	if(length > (output->limit - Compression_Output_Length(output))) {
+		return COMPRESSION_OVERFLOW;
+	}
+
+	while(length > 0) {
+		chunk = output->stagingSize - output->stagingFill;
+		if(chunk > length) {
+			chunk = length;
+		}
+		memcpy(&output->staging[output->stagingFill], data, chunk);
+		output->stagingFill += chunk;
+		data += chunk;
+		length -= chunk;
+
+		if(output->stagingFill == output->stagingSize) {
+			if(output->sink(output->flushedLength, output->staging, output->stagingSize) != 0) {
+				return COMPRESSION_SINK_ERROR;
+			}
+			output->flushedLength += output->stagingSize;
+			output->stagingFill = 0;
+		}
+	}
+	return COMPRESSION_OK;
+}
+
+static uint8_t Compression_Repeat(Compression_Output_t *output, uint8_t value, uint32_t count)
+{
+	uint8_t pattern[32];
+	uint32_t chunk = 0;
+	uint8_t status = COMPRESSION_OK;
+
+	memset(pattern, value, sizeof(pattern));
+	while((count > 0) && (status == COMPRESSION_OK)) {
+		chunk = (count > sizeof(pattern)) ? sizeof(pattern) : count;
+		status = Compression_Put(output, pattern, chunk);
+		count -= chunk;
+	}
+	return status;
+}
+
+/**
+ * Copies length bytes starting offset bytes back in the output. The source
+ * is either the staging buffer or the flushed output; the copy goes in
+ * pieces that never cross from one to the other, never overlap their
+ * destination and never trigger a flush halfway.
+ */
+static uint8_t Compression_Copy_Match(Compression_Output_t *output, uint32_t offset, uint32_t length)
+{
+	uint32_t source = 0;
+	uint32_t chunk = 0;
+	const uint8_t *from = NULL;
+	uint8_t status = COMPRESSION_OK;
+
+	if((offset == 0) || (offset > Compression_Output_Length(output))
+			|| ((output->flushed == NULL) && (offset > output->stagingFill))) {
+		return COMPRESSION_CORRUPT;
+	}
+
+	while((length > 0) && (status == COMPRESSION_OK)) {
+		source = Compression_Output_Length(output) - offset;
+		chunk = output->stagingSize - output->stagingFill;
+
+		if(source >= output->flushedLength) {
+			from = &output->staging[source - output->flushedLength];
+		}
+		else {
+			from = &output->flushed[source];
+			if(chunk > (output->flushedLength - source)) {
+				chunk = output->flushedLength - source;
+			}
+		}
+		if(chunk > offset) {
+			chunk = offset;		/* Overlapping matches repeat the last offset bytes */
+		}
+		if(chunk > length) {
+			chunk = length;
+		}
+		status = Compression_Put(output, from, chunk);
+		length -= chunk;
+	}
+	return status;
+}
+
+static uint8_t Compression_Decode_RLE(Compression_Output_t *output, const uint8_t *input, uint32_t inputLength)
+{
+	const uint8_t *end = input + inputLength;
+	uint32_t count = 0;
+	uint8_t control = 0;
+	uint8_t status = COMPRESSION_OK;
+
+	while((input < end) && (status == COMPRESSION_OK)) {
+		control = *input++;
+		count = (uint32_t)(control & 0x7F) + 1;
+
+		if(control & 0x80) {
+			if(input >= end) {
+				return COMPRESSION_CORRUPT;
+			}
+			status = Compression_Repeat(output, *input++, count);
+		}
+		else {
+			if(count > (uint32_t)(end - input)) {
+				return COMPRESSION_CORRUPT;
+			}
+			status = Compression_Put(output, input, count);
+			input += count;
+		}
+	}
+	return status;
+}
+
+/**
+ * Sequences: [Token][Literal Length Bytes][Literals][Offset:16][Match Length Bytes]
+ * The token holds the literal length (high nibble) and the match length - 4
+ * (low nibble), 15 means more length bytes follow. The last sequence stops
+ * after its literals.
+ */
+static uint8_t Compression_Decode_LZ4(Compression_Output_t *output, const uint8_t *input, uint32_t inputLength)
+{
+	const uint8_t *end = input + inputLength;
+	uint32_t literalLength = 0;
+	uint32_t matchLength = 0;
+	uint32_t offset = 0;
+	uint8_t token = 0;
+	uint8_t status = COMPRESSION_OK;
+
+	while((input < end) && (status == COMPRESSION_OK)) {
+		token = *input++;
+
+		literalLength = token >> 4;
+		if((literalLength == 15) && (Compression_Read_Length(&input, end, &literalLength) != COMPRESSION_OK)) {
+			return COMPRESSION_CORRUPT;
+		}
+		if(literalLength > (uint32_t)(end - input)) {
+			return COMPRESSION_CORRUPT;
+		}
+		status = Compression_Put(output, input, literalLength);
+		input += literalLength;
+
+		if((input == end) || (status != COMPRESSION_OK)) {
+			break;
+		}
+
+		if((end - input) < 2) {
+			return COMPRESSION_CORRUPT;
+		}
+		offset = (uint32_t)input[0] | ((uint32_t)input[1] << 8);
+		input += 2;
+
+		matchLength = token & 0x0F;
+		if((matchLength == 15) && (Compression_Read_Length(&input, end, &matchLength) != COMPRESSION_OK)) {
+			return COMPRESSION_CORRUPT;
+		}
+		status = Compression_Copy_Match(output, offset, matchLength + 4);
+	}
+	return status;
+}
+
+/* Adds the 255 terminated length extension bytes to length */
+static uint8_t Compression_Read_Length(const uint8_t **input, const uint8_t *end, uint32_t *length)
+{
+	uint8_t value = 0;
+
+	do {
+		if((*input >= end) || (*length > (UINT32_MAX - 255))) {
+			return COMPRESSION_CORRUPT;
+		}
+		value = *(*input)++;
+		*length += value;
+	} while(value == 255);
+
+	return COMPRESSION_OK;
+}
+
+/* Runs of 3 bytes or more are repeated, everything else is copied */
+static uint32_t Compression_Encode_RLE(const uint8_t *input, uint32_t inputLength, uint8_t *output, uint32_t outputSize)
+{
+	uint32_t position = 0;
+	uint32_t literalStart = 0;
+	uint32_t literalLength = 0;
+	uint32_t run = 0;
+	uint32_t i = 0;
+
+	while(i <= inputLength) {
+		run = 1;
+		while(((i + run) < inputLength) && (run < 128) && (input[i + run] == input[i])) {
+			run++;
+		}
+
+		if((run >= 3) || (i == inputLength)) {
+			/* Flush the literals in front of the run, 128 at most per control byte */
+			while(literalStart < i) {
+				literalLength = ((i - literalStart) > 128) ? 128 : (i - literalStart);
+				if((position + 1 + literalLength) > outputSize) {
+					return 0;
+				}
+				output[position++] = (uint8_t)(literalLength - 1);
+				memcpy(&output[position], &input[literalStart], literalLength);
+				position += literalLength;
+				literalStart += literalLength;
+			}
+			if(i == inputLength) {
+				break;
+			}
+			if((position + 2) > outputSize) {
+				return 0;
+			}
+			output[position++] = (uint8_t)(0x80 | (run - 1));
+			output[position++] = input[i];
+			literalStart = i + run;
+		}
+		i += run;
+	}
+	return position;
+}
+
+/* Greedy single pass LZ4: a match is taken as soon as the hashed 4 bytes repeat */
+static uint32_t Compression_Encode_LZ4(const uint8_t *input, uint32_t inputLength, uint8_t *output, uint32_t outputSize)
+{
+	uint32_t position = 0;
+	uint32_t anchor = 0;
+	uint32_t current = 0;
+	uint32_t candidate = 0;
+	uint32_t matchLength = 0;
+	uint32_t sequence = 0;
+	uint32_t hash = 0;
+
+	memset(lz4HashTable, 0, sizeof(lz4HashTable));
+
+	while((current + COMPRESSION_LZ4_MATCH_LIMIT) <= inputLength) {
+		memcpy(&sequence, &input[current], sizeof(sequence));
+		hash = COMPRESSION_LZ4_HASH(sequence);
+		candidate = lz4HashTable[hash];
+		lz4HashTable[hash] = (uint16_t)(current + 1);
+
+		if((candidate == 0) || (memcmp(&input[candidate - 1], &input[current], COMPRESSION_LZ4_MIN_MATCH) != 0)) {
+			current++;
+			continue;
+		}
+		candidate--;
+
+		matchLength = COMPRESSION_LZ4_MIN_MATCH;
+		while(((current + matchLength) < (inputLength - COMPRESSION_LZ4_LAST_LITERALS))
+				&& (input[candidate + matchLength] == input[current + matchLength])) {
+			matchLength++;
+		}
+
+		position = Compression_Put_Sequence(output, outputSize, position, &input[anchor], current - anchor,
+				current - candidate, matchLength);
+		if(position == 0) {
+			return 0;
+		}
+		current += matchLength;
+		anchor = current;
+	}
+
+	return Compression_Put_Literals(output, outputSize, position, &input[anchor], inputLength - anchor);
+}
+
+/* The last sequence: a token and the literals, no match */
+static uint32_t Compression_Put_Literals(uint8_t *output, uint32_t outputSize, uint32_t position,
+		const uint8_t *literals, uint32_t length)
+{
+	if(position >= outputSize) {
+		return 0;
+	}
+	output[position++] = (uint8_t)(((length >= 15) ? 15 : length) << 4);
+	if(length >= 15) {
+		position = Compression_Put_Length(output, outputSize, position, length - 15);
+	}
+	if((position == 0) || ((position + length) > outputSize)) {
+		return 0;
+	}
+	memcpy(&output[position], literals, length);
+	return position + length;
+}
+
+/* [Token][Literal Length Bytes][Literals][Offset:16][Match Length Bytes] */
+static uint32_t Compression_Put_Sequence(uint8_t *output, uint32_t outputSize, uint32_t position,
+		const uint8_t *literals, uint32_t literalLength, uint32_t offset, uint32_t matchLength)
+{
+	uint32_t tokenPosition = position;
+	uint32_t matchCode = matchLength - COMPRESSION_LZ4_MIN_MATCH;
+
+	position = Compression_Put_Literals(output, outputSize, position, literals, literalLength);
+	if((position == 0) || ((position + 2) > outputSize)) {
+		return 0;
+	}
+	output[tokenPosition] |= (uint8_t)((matchCode >= 15) ? 15 : matchCode);
+	output[position++] = (uint8_t)offset;
+	output[position++] = (uint8_t)(offset >> 8);
+	if(matchCode >= 15) {
+		position = Compression_Put_Length(output, outputSize, position, matchCode - 15);
+	}
+	return position;
+}
+
+/* Writes the 255 terminated length extension bytes, 0 if they don't fit */
+static uint32_t Compression_Put_Length(uint8_t *output, uint32_t outputSize, uint32_t position, uint32_t length)
+{
+	do {
+		if(position >= outputSize) {
+			return 0;
+		}
+		output[position++] = (uint8_t)((length >= 255) ? 255 : length);
+		if(length < 255) {
+			break;
+		}
+		length -= 255;
+	} while(1);
+
+	return position;
+}
@@ -0,0 +1,133 @@
+/**
+ ******************************************************************************
+ * @file           : crcServices.c
+ * @author         : Mostafa Asaad (https://github.com/M0stafa077)
+ * @brief          : CRC unit services implementation.
+ *                   Long ranges are streamed into the CRC data register by a
+ *                   DMA2 memory to memory stream, the core only waits.
+ *                   Every calculation falls back on the table driven
+ *                   kernels of crcSoftware.c when the unit is not used.
+ ******************************************************************************
+ */
+
+/*---------------  Section: Includes --------------- */
+
+#include "crcServices/crcServices.h"
+
+/*---------------  Section: Private Variables --------------- */
+
+/* !< Cleared when the CRC unit is configured out or failed the self test */
+static uint8_t crcHardwareUsable = BL_CRC_USE_HARDWARE;
+
+/* !< Self test input, the classic check string */
+static const uint8_t crcCheckInput[12] __ALIGNED(4) = { '1', '2', '3', '4', '5', '6', '7', '8', '9', 0, 0, 0 };
+
+/*---------------  Section: Functions Definition --------------- */
+
+/**
+ * @brief  Computes the CRC of a word aligned flash or SRAM range.
+ *         The result is the STM32 CRC unit one: polynomial 0x04C11DB7,
+ *         initial value 0xFFFFFFFF, fed one word at a time as laid out in
+ *         memory. It equals Crc_Calculate_Words() over the range.
+ * @param  address: Word aligned start address.
+ * @param  length: Length in bytes, a multiple of 4.
+ * @retval The CRC of the range.
+ */
+uint32_t Crc_Calculate_Range(uint32_t address, uint32_t length)
+{
+	uint32_t startAddress = address;
+	uint32_t wordCount = length / 4;
+	uint32_t chunk = 0;
+
+	if(!crcHardwareUsable) {
+		return Crc_Table_Words(CRC_SOFTWARE_INIT, (const uint32_t *)address, wordCount);
+	}
+
+	__HAL_CRC_DR_RESET(&hcrc);
+
+	while(wordCount >= CRC_DMA_MIN_WORDS) {
+		chunk = (wordCount > CRC_DMA_MAX_WORDS) ? CRC_DMA_MAX_WORDS : wordCount;
+
+		/* The source walks the range, the destination stays on the data register */
+		if(HAL_DMA_Start(&hdma_memtomem_dma2_stream0, address, (uint32_t)&CRC->DR, chunk) != HAL_OK) {
+			break;	/* Nothing of this chunk reached the CRC unit, the CPU goes on */
+		}
+		if(HAL_DMA_PollForTransfer(&hdma_memtomem_dma2_stream0, HAL_DMA_FULL_TRANSFER,
+				CRC_DMA_TIMEOUT_MS) != HAL_OK) {
+			/* An unknown part went in, start over with the CPU */
+			HAL_DMA_Abort(&hdma_memtomem_dma2_stream0);
+			return HAL_CRC_Calculate(&hcrc, (uint32_t *)startAddress, length / 4);
+		}
+		address += chunk * 4;
+		wordCount -= chunk;
+	}
+
+	/* The short tail, or everything the DMA didn't take */
+	return HAL_CRC_Accumulate(&hcrc, (uint32_t *)address, wordCount);
+}
+
+/**
+ * @brief  Computes the CRC of words in RAM, the v2 frame CRC.
+ * @param  words: Word aligned data.
+ * @param  wordCount: Number of words.
+ * @retval The CRC, as Crc_Table_Words() from CRC_SOFTWARE_INIT.
+ */
+uint32_t Crc_Calculate_Words(const uint32_t *words, uint32_t wordCount)
+{
+	if(!crcHardwareUsable) {
+		return Crc_Table_Words(CRC_SOFTWARE_INIT, words, wordCount);
+	}
+
+	LL_CRC_ResetCRCCalculationUnit(CRC);
+	for(uint32_t i = 0; i < wordCount; ++i) {
+		LL_CRC_FeedData32(CRC, words[i]);
+	}
+	return LL_CRC_ReadData32(CRC);
+}
+
+/**
+ * @brief  Computes the CRC of bytes each fed as a word, the v1 frame CRC.
+ * @param  bytes: The data.
+ * @param  length: Number of bytes.
+ * @retval The CRC, as Crc_Table_Bytes() from CRC_SOFTWARE_INIT.
+ */
+uint32_t Crc_Calculate_Bytes(const uint8_t *bytes, uint32_t length)
+{
+	if(!crcHardwareUsable) {
+		return Crc_Table_Bytes(CRC_SOFTWARE_INIT, bytes, length);
+	}
+
+	LL_CRC_ResetCRCCalculationUnit(CRC);
+	for(uint32_t i = 0; i < length; ++i) {
+		LL_CRC_FeedData32(CRC, bytes[i]);
+	}
+	return LL_CRC_ReadData32(CRC);
+}
+
+/**
+ * @brief  Cross checks the CRC unit with the table driven kernels, for both
+ *         the word and the byte feeds. The unit is left unused on a mismatch.
+ * @retval 1 if the unit is used and agrees with the tables, 0 otherwise.
+ */
+uint8_t Crc_Self_Test(void)
+{
+	uint8_t usable = crcHardwareUsable;
+
+	if(usable) {
+		usable = (Crc_Calculate_Words((const uint32_t *)crcCheckInput, sizeof(crcCheckInput) / 4)
+					== Crc_Table_Words(CRC_SOFTWARE_INIT, (const uint32_t *)crcCheckInput, sizeof(crcCheckInput) / 4))
+				&& (Crc_Calculate_Bytes(crcCheckInput, 9)
+					== Crc_Table_Bytes(CRC_SOFTWARE_INIT, crcCheckInput, 9));
+	}
+	crcHardwareUsable = usable;
+	return usable;
+}
+
+/**
+ * @brief  Releases the CRC unit and its DMA stream before leaving the bootloader.
+ */
+void Crc_DeInit(void)
+{
+	HAL_DMA_DeInit(&hdma_memtomem_dma2_stream0);
+	HAL_CRC_DeInit(&hcrc);
+}
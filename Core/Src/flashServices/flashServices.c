@@ -15,8 +15,27 @@
 #define FLASH_CR_KEY_1					(0x45670123UL)
 #define FLASH_CR_KEY_2					(0xCDEF89ABUL)
 
+#define FLASH_PARALLELISM_8				(0x00000000UL)
+#define FLASH_PARALLELISM_16			(0x00000001UL)
 #define FLASH_PARALLELISM_32			(0x00000002UL)
+#define FLASH_PARALLELISM_64			(0x00000003UL)
 #define FLASH_PSIIZE_POS				(0x08UL)
+
+/* !< The voltage range encoding is the PSIZE one: erases use the widest parallelism
+ *    of the supply, programs stop at x32 as they write one word at a time */
+#define FLASH_ERASE_PARALLELISM			(BL_FLASH_VOLTAGE_RANGE)
+#if (BL_FLASH_VOLTAGE_RANGE > FLASH_PARALLELISM_32)
+#define FLASH_PROGRAM_PARALLELISM		FLASH_PARALLELISM_32
+#else
+#define FLASH_PROGRAM_PARALLELISM		(BL_FLASH_VOLTAGE_RANGE)
+#endif
+
+/* !< Words flashWrite() swaps on the stack per program call, a whole v1 payload */
+#define FLASH_WRITE_CHUNK_WORDS			64U
+
+/* !< Status flags of a failed program or erase operation */
+#define FLASH_SR_ERRORS					(FLASH_SR_SOP | FLASH_SR_WRPERR | FLASH_SR_PGAERR \
+										| FLASH_SR_PGPERR | FLASH_SR_PGSERR | FLASH_SR_RDERR)
 /* --------------- Section: Private Macro Functions Declarations --------------- */
 
 #define FLASH_WAIT_FOR_COMPLETION()		while(READ_BIT(FLASH->SR, 16))
@@ -35,10 +54,44 @@ typedef enum
 	FLASH_SECTOR_5_NUMBER = 21
 } Flash_Sector_t;
 
+/*---------------  Section: Private Variables --------------- */
+
+/* !< Sector i spans [flashSectorBase[i], flashSectorBase[i + 1]) */
+static const uint32_t flashSectorBase[FLASH_SECTOR_TOTAL + 1] = {
+	0x08000000UL, 0x08004000UL, 0x08008000UL, 0x0800C000UL,	/* 16 KB sectors */
+	0x08010000UL,											/* 64 KB sector */
+	0x08020000UL,											/* 128 KB sector */
+	FLASH_END + 1UL
+};
+
+/* !< Set between Flash_Session_Begin() and Flash_Session_End(), the control register stays unlocked */
+static uint8_t flashSessionActive = 0;
+
+/* !< HAL_FLASH_ERROR_xxx bits of the last failed operation */
+static uint32_t flashLastError = HAL_FLASH_ERROR_NONE;
+
+/* !< Sectors the last erase found blank and left alone */
+static uint32_t flashSkippedSectors = 0;
+
+/* !< Background erase: sectors waiting, the one erasing and the ones done.
+ *    A paused erase starts no new sector, so words can be programmed. */
+static volatile uint32_t eraseQueue = 0;
+static volatile uint32_t eraseActiveSector = FLASH_INVALID_SECTOR;
+static volatile uint32_t eraseDone = 0;
+static volatile uint8_t erasePaused = 0;
+/* !< Sectors whose erase failed or was dropped after a failure. Nothing is
+ *    programmed there until a new erase of the sector succeeds. */
+static volatile uint32_t eraseFailed = 0;
+
 /*---------------  Section: Private Helper Function Declarations --------------- */
 static Std_ReturnType_t Flash_Unlock(void);
 static Std_ReturnType_t Flash_Lock(void);
 static Std_ReturnType_t Flash_Erase_Sector(const Flash_Sector_t Sector);
+static inline void Flash_Program_Word(volatile uint32_t *destination, uint32_t word);
+static uint32_t Flash_Decode_Errors(uint32_t status);
+static void Flash_Erase_Next(void);
+static void Flash_Erase_Hold(void);
+static void Flash_Erase_Release(void);
 
 /*---------------  Section: Functions Definition --------------- */
 
@@ -68,40 +121,401 @@ Std_ReturnType_t Flash_Erase_Mass(void)
  */
 /**
  * @brief Write data to a specific address in flash memory.
+ *        Every 4 bytes are byte swapped into a word (big endian data, as
+ *        the v1 frames carry it), a missing tail byte is written as 0xFF.
+ *        The swapped words go to the flash in one program call per
+ *        FLASH_WRITE_CHUNK_WORDS.
  * @param address The starting flash memory address to write to.
  * @param data The data to write.
  * @param length The length of the data array.
  * @return HAL_StatusTypeDef Status of the flash write operation.
  */
 HAL_StatusTypeDef flashWrite(uint32_t address, uint8_t* data, uint32_t length) {
+    HAL_StatusTypeDef status = Flash_Session_Begin();
+    uint32_t words[FLASH_WRITE_CHUNK_WORDS];
+    uint32_t wordCount = 0;
+
+    for (uint32_t start = 0; (start < length) && (status == HAL_OK); start += wordCount * 4) {
+        for (wordCount = 0; (wordCount < FLASH_WRITE_CHUNK_WORDS) && ((start + (wordCount * 4)) < length); ++wordCount) {
+            words[wordCount] = 0;
+            for (uint32_t i = start + (wordCount * 4); i < (start + (wordCount * 4) + 4); ++i) {
+                words[wordCount] = (words[wordCount] << 8) | ((i < length) ? data[i] : 0xFFU);
+            }
+        }
+        status = Flash_Session_Program(address + start, words, wordCount);
+    }
+
+    return status;
+}
+
+/**
+ * @brief Write words to flash memory as they are laid out in RAM.
+ *        Unlike flashWrite(), no byte swapping is applied.
+ *        The programming session is opened on the first write and kept
+ *        open for the next ones, see Flash_Session_Begin().
+ * @param address The word aligned flash memory address to write to.
+ * @param data The word aligned data to write.
+ * @param wordCount The number of 32-bit words to write.
+ * @return HAL_StatusTypeDef Status of the flash write operation.
+ */
+HAL_StatusTypeDef flashWriteWords(uint32_t address, const uint32_t* data, uint32_t wordCount) {
+    HAL_StatusTypeDef status = Flash_Session_Begin();
+
+    if (status == HAL_OK) {
+        status = Flash_Session_Program(address, data, wordCount);
+    }
+
+    return status;
+}
+
+/**
+ * @brief Fills consecutive words with the same pattern.
+ *        Words already holding the pattern (e.g. 0xFFFFFFFF on erased
+ *        flash) are not programmed again.
+ * @param address The word aligned flash memory address to fill from.
+ * @param pattern The word programmed, as laid out in memory.
+ * @param wordCount The number of 32-bit words to fill.
+ * @return HAL_StatusTypeDef Status of the fill, HAL_ERROR if a word doesn't
+ *         read back as the pattern (it wasn't erased).
+ */
+HAL_StatusTypeDef Flash_Fill_Words(uint32_t address, uint32_t pattern, uint32_t wordCount) {
+    HAL_StatusTypeDef status = Flash_Session_Begin();
+    volatile uint32_t *word = (volatile uint32_t *)address;
+    uint32_t sectorMask = Flash_Plan_Erase(address, wordCount * 4);
+
+    /* The words are compared before programming, they must not be erased afterwards */
+    Flash_Erase_Wait(sectorMask);
+    if (sectorMask & eraseFailed) {
+        status = HAL_ERROR;
+    }
+
+    for (uint32_t i = 0; (i < wordCount) && (status == HAL_OK); ++i) {
+        if (word[i] == pattern) {
+            continue;
+        }
+        status = Flash_Session_Program(address + (i * 4), &pattern, 1);
+
+        if ((status == HAL_OK) && (word[i] != pattern)) {
+            status = HAL_ERROR;
+        }
+    }
+
+    return status;
+}
+
+/**
+ * @brief Erases consecutive sectors.
+ * @param firstSector The first sector, FLASH_SECTOR_0 to FLASH_SECTOR_5.
+ * @param sectorCount The number of sectors to erase.
+ * @return HAL_StatusTypeDef Status of the erase operation.
+ */
+HAL_StatusTypeDef Flash_Erase_Sectors(uint32_t firstSector, uint32_t sectorCount) {
+    FLASH_EraseInitTypeDef eraseInit = { 0 };
     HAL_StatusTypeDef status = HAL_OK;
-    uint32_t word = 0x00;
+    uint32_t sectorError = 0;
+
+    if ((sectorCount == 0) || (firstSector >= FLASH_SECTOR_TOTAL)
+    		|| (sectorCount > (FLASH_SECTOR_TOTAL - firstSector))) {
+        return HAL_ERROR;
+    }
+
+    eraseInit.TypeErase = FLASH_TYPEERASE_SECTORS;
+    eraseInit.NbSectors = 1;
+    eraseInit.VoltageRange = BL_FLASH_VOLTAGE_RANGE;
+
+    Flash_Erase_Wait(FLASH_ALL_SECTORS_MASK);
+    flashSkippedSectors = 0;
+#if BL_SKIP_BLANK_SECTORS
+    flashSkippedSectors = Flash_Get_Blank_Sectors(((1UL << sectorCount) - 1) << firstSector);
+#endif
 
     HAL_FLASH_Unlock();
+    for (uint32_t sector = firstSector; (sector < (firstSector + sectorCount)) && (status == HAL_OK); ++sector) {
+        if (flashSkippedSectors & (1UL << sector)) {
+            continue;
+        }
+        eraseInit.Sector = sector;
+        status = HAL_FLASHEx_Erase(&eraseInit, &sectorError);
+    }
+    if (status != HAL_OK) {
+        flashLastError = HAL_FLASH_GetError();
+    }
+    else {
+        eraseFailed &= ~(((1UL << sectorCount) - 1) << firstSector);
+    }
+    if (!flashSessionActive) {
+        HAL_FLASH_Lock();
+    }
+
+    return status;
+}
+
+/**
+ * @brief Returns the sector holding an address.
+ * @param address Any flash address.
+ * @return The sector number (FLASH_SECTOR_x), or FLASH_INVALID_SECTOR.
+ */
+uint32_t Flash_Get_Sector(uint32_t address) {
+    for (uint32_t sector = 0; sector < FLASH_SECTOR_TOTAL; ++sector) {
+        if ((address >= flashSectorBase[sector]) && (address < flashSectorBase[sector + 1])) {
+            return sector;
+        }
+    }
+    return FLASH_INVALID_SECTOR;
+}
+
+/**
+ * @brief Returns the first address of a sector.
+ * @param sector The sector number, FLASH_SECTOR_TOTAL gives the end of the flash.
+ * @return The sector base address.
+ */
+uint32_t Flash_Get_Sector_Base(uint32_t sector) {
+    return (sector <= FLASH_SECTOR_TOTAL) ? flashSectorBase[sector] : (FLASH_END + 1UL);
+}
+
+/**
+ * @brief Maps a range onto the sector geometry.
+ * @param address The first flash address of the range.
+ * @param length The range length in bytes.
+ * @return Bit n set for every sector n the range touches, 0 if the range
+ *         is empty or leaves the flash.
+ */
+uint32_t Flash_Plan_Erase(uint32_t address, uint32_t length) {
+    uint32_t firstSector = Flash_Get_Sector(address);
+    uint32_t lastSector = Flash_Get_Sector(address + length - 1);
 
-    for (uint32_t i = 0; i < length; i += 4) {
-        word = data[i] | (data[i + 1] << 8) | (data[i + 2] << 16) | (data[i + 3] << 24);
+    if ((length == 0) || (firstSector == FLASH_INVALID_SECTOR) || (lastSector == FLASH_INVALID_SECTOR)
+    		|| (lastSector < firstSector)) {
+        return 0;
+    }
+    return ((1UL << (lastSector + 1)) - 1) & ~((1UL << firstSector) - 1);
+}
 
-        word = convertWordToBigEndian(word);
+/**
+ * @brief Returns what made the last flash operation fail.
+ * @return HAL_FLASH_ERROR_xxx bits, HAL_FLASH_ERROR_NONE if nothing failed yet.
+ */
+uint32_t Flash_Get_Last_Error(void) {
+    return flashLastError;
+}
 
-        status = HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD, address + i, word);
+/**
+ * @brief Blank checks sectors, word by word, stopping at the first
+ *        programmed word of each sector.
+ * @param sectorMask Bit n set to check sector n.
+ * @return The sectors of the mask holding only 0xFF.
+ */
+uint32_t Flash_Get_Blank_Sectors(uint32_t sectorMask) {
+    uint32_t blankSectors = 0;
 
-        if (status != HAL_OK) {
-            break;
+    for (uint32_t sector = 0; sector < FLASH_SECTOR_TOTAL; ++sector) {
+        const uint32_t *word = (const uint32_t *)flashSectorBase[sector];
+        const uint32_t *end = (const uint32_t *)flashSectorBase[sector + 1];
+        uint32_t blank = 0xFFFFFFFFUL;
+
+        if (!(sectorMask & (1UL << sector))) {
+            continue;
+        }
+        /* Four words per test, every sector size is a multiple of 16 bytes */
+        while ((word < end) && (blank == 0xFFFFFFFFUL)) {
+            blank = word[0] & word[1] & word[2] & word[3];
+            word += 4;
+        }
+        if (blank == 0xFFFFFFFFUL) {
+            blankSectors |= (1UL << sector);
         }
     }
+    return blankSectors;
+}
+
+/**
+ * @brief Returns the sectors the last erase skipped, as they were blank
+ *        already. Always 0 when BL_SKIP_BLANK_SECTORS is off.
+ */
+uint32_t Flash_Get_Skipped_Sectors(void) {
+    return flashSkippedSectors;
+}
 
-    HAL_FLASH_Lock();
+/**
+ * @brief Opens a programming session: the control register stays unlocked
+ *        until Flash_Session_End(). Opening an open session does nothing.
+ * @return HAL_StatusTypeDef HAL_OK, HAL_ERROR if the flash didn't unlock.
+ */
+HAL_StatusTypeDef Flash_Session_Begin(void) {
+    if (flashSessionActive) {
+        return HAL_OK;
+    }
 
-    return status;
+    FLASH_WAIT_FOR_COMPLETION();
+    if (Flash_Unlock() != E_OK) {
+        return HAL_ERROR;
+    }
+
+    /* Errors left by an earlier operation would block the next ones */
+    FLASH->SR = FLASH_SR_ERRORS;
+    flashSessionActive = 1;
+
+    return HAL_OK;
+}
+
+/**
+ * @brief Programs words as they are laid out in RAM, in a register level
+ *        loop. The status register is checked once, after the last word.
+ *        A supply below 2.7 V programs every word in halfwords or bytes.
+ * @param address The word aligned flash memory address to write to.
+ * @param data The words to write.
+ * @param wordCount The number of 32-bit words to write.
+ * @return HAL_StatusTypeDef HAL_OK, HAL_ERROR if no session is open or a
+ *         word failed (the error flags are then cleared).
+ */
+HAL_StatusTypeDef Flash_Session_Program(uint32_t address, const uint32_t* data, uint32_t wordCount) {
+    volatile uint32_t *destination = (volatile uint32_t *)address;
+    uint32_t sectorMask = Flash_Plan_Erase(address, wordCount * 4);
+    uint32_t errors = 0;
+
+    if (!flashSessionActive) {
+        return HAL_ERROR;
+    }
+
+    /* The target sectors must be erased first, then the erase of the next ones waits.
+     * A sector left un-erased would AND the words in without any error flag. */
+    Flash_Erase_Wait(sectorMask);
+    if (sectorMask & eraseFailed) {
+        flashLastError |= HAL_FLASH_ERROR_OPERATION;
+        return HAL_ERROR;
+    }
+    Flash_Erase_Hold();
+
+    /* An erase in between may have left a wider parallelism */
+    MODIFY_REG(FLASH->CR, FLASH_CR_PSIZE, (FLASH_PROGRAM_PARALLELISM << FLASH_PSIIZE_POS) | FLASH_CR_PG);
+
+    for (uint32_t i = 0; i < wordCount; ++i) {
+        Flash_Program_Word(&destination[i], data[i]);
+    }
+
+    CLEAR_BIT(FLASH->CR, FLASH_CR_PG);
+
+    errors = FLASH->SR & FLASH_SR_ERRORS;
+    if (errors != 0) {
+        FLASH->SR = errors;
+        flashLastError = Flash_Decode_Errors(errors);
+    }
+    Flash_Erase_Release();
+
+    return (errors != 0) ? HAL_ERROR : HAL_OK;
+}
+
+/**
+ * @brief Closes the programming session and locks the control register.
+ * @return HAL_StatusTypeDef HAL_OK, HAL_ERROR if the flash didn't lock.
+ */
+HAL_StatusTypeDef Flash_Session_End(void) {
+    if (!flashSessionActive) {
+        return HAL_OK;
+    }
+
+    Flash_Erase_Wait(FLASH_ALL_SECTORS_MASK);
+    FLASH_WAIT_FOR_COMPLETION();
+    flashSessionActive = 0;
+
+    return (Flash_Lock() == E_OK) ? HAL_OK : HAL_ERROR;
+}
+
+/**
+ * @brief Queues sectors for a background erase, driven by the end of
+ *        operation interrupt from one sector to the next, lowest first.
+ *        The call returns at once. Programming a sector waits for its
+ *        erase, the erase of the next sectors then waits for the program.
+ *        The CPU stalls on flash fetches while a sector erases, the host
+ *        link keeps receiving into its DMA ring meanwhile.
+ * @param sectorMask Bit n set to erase sector n.
+ * @return HAL_StatusTypeDef HAL_OK, HAL_ERROR for an empty or invalid mask
+ *         or if the flash didn't unlock.
+ */
+HAL_StatusTypeDef Flash_Erase_Start(uint32_t sectorMask) {
+    if ((sectorMask == 0) || (sectorMask & ~FLASH_ALL_SECTORS_MASK)
+    		|| (Flash_Session_Begin() != HAL_OK)) {
+        return HAL_ERROR;
+    }
+
+    /* A sector still queued may hold anything, it is erased again */
+    flashSkippedSectors = 0;
+#if BL_SKIP_BLANK_SECTORS
+    flashSkippedSectors = Flash_Get_Blank_Sectors(sectorMask & ~Flash_Erase_Pending());
+#endif
+
+    __disable_irq();
+    eraseFailed &= ~sectorMask;
+    eraseQueue |= (sectorMask & ~flashSkippedSectors);
+    eraseDone = (eraseDone & ~sectorMask) | flashSkippedSectors;
+    if ((eraseActiveSector == FLASH_INVALID_SECTOR) && !erasePaused) {
+        Flash_Erase_Next();
+    }
+    __enable_irq();
+
+    return HAL_OK;
+}
+
+/**
+ * @brief Waits until none of the sectors is queued or erasing anymore.
+ * @param sectorMask Bit n set to wait for sector n.
+ */
+void Flash_Erase_Wait(uint32_t sectorMask) {
+    while (Flash_Erase_Pending() & sectorMask) {
+    }
+}
+
+/**
+ * @brief Returns the sectors queued or erasing in the background.
+ */
+uint32_t Flash_Erase_Pending(void) {
+    uint32_t activeSector = eraseActiveSector;
+
+    return eraseQueue | ((activeSector != FLASH_INVALID_SECTOR) ? (1UL << activeSector) : 0);
+}
+
+/**
+ * @brief Returns the sectors the background erase completed. A sector
+ *        neither pending nor done failed, see Flash_Get_Last_Error().
+ */
+uint32_t Flash_Erase_Done(void) {
+    return eraseDone;
+}
+
+/**
+ * @brief End of operation and error interrupt of a background erase,
+ *        called from FLASH_IRQHandler(). An error drops the queued sectors.
+ */
+void Flash_Erase_IRQ_Handler(void) {
+    uint32_t status = FLASH->SR;
+    uint32_t errors = status & FLASH_SR_ERRORS;
+
+    if ((eraseActiveSector == FLASH_INVALID_SECTOR) || !((status & FLASH_SR_EOP) || errors)) {
+        return;
+    }
+
+    FLASH->SR = FLASH_SR_EOP | errors;
+    CLEAR_BIT(FLASH->CR, FLASH_CR_SER | FLASH_CR_SNB | FLASH_CR_EOPIE | FLASH_CR_ERRIE);
+    if (errors != 0) {
+        flashLastError = Flash_Decode_Errors(errors);
+        eraseFailed |= eraseQueue | (1UL << eraseActiveSector);
+        eraseQueue = 0;
+    }
+    else {
+        eraseDone |= (1UL << eraseActiveSector);
+    }
+    eraseActiveSector = FLASH_INVALID_SECTOR;
+    FLASH_FlushCaches();
+
+    if (!erasePaused) {
+        Flash_Erase_Next();
+    }
 }
 
 /*---------------  Section: Private Helper Function Definitions --------------- */
 
+/* Interrupts stay enabled: the host link keeps receiving during a session */
 static Std_ReturnType_t Flash_Unlock(void) {
-	// Disable interrupts
-	__disable_irq();
-
 	if(!READ_BIT(FLASH->CR, 31)) {
 		// Control register is already unlocked
 		return E_OK;
@@ -118,9 +532,6 @@ static Std_ReturnType_t Flash_Lock(void) {
 	// Set the LOCK bit
 	SET_BIT(FLASH->CR, 31);
 
-	// Re-enable interrupts
-    __enable_irq();
-
     // Return the status
 	return (READ_BIT(FLASH->CR, 31) ? E_OK : E_NOT_OK);
 }
@@ -137,35 +548,149 @@ static Std_ReturnType_t Flash_Lock(void) {
 static Std_ReturnType_t Flash_Erase_Sector(const Flash_Sector_t Sector)
 {
 	Std_ReturnType_t retVal = E_OK;
+	uint32_t sectorNumber = (uint32_t)Sector - (uint32_t)FLASH_SECTOR_0_NUMBER;
+	uint32_t errors = 0;
 
-	if((uint32_t)Sector > (uint32_t)FLASH_SECTOR_5) {
+	if(sectorNumber >= FLASH_SECTOR_TOTAL) {
 		retVal |= E_NOT_OK;
 	}
 	else
 	{
-		/* 1. Wait for the Flash Memory to be free */
+		/* 1. Wait for the Flash Memory to be free, background erase included */
+		Flash_Erase_Wait(FLASH_ALL_SECTORS_MASK);
 		FLASH_WAIT_FOR_COMPLETION();
 
+		/* 1.1 A blank sector needs no erase */
+		flashSkippedSectors = 0;
+#if BL_SKIP_BLANK_SECTORS
+		flashSkippedSectors = Flash_Get_Blank_Sectors(1UL << sectorNumber);
+		if(flashSkippedSectors != 0) {
+			eraseFailed &= ~flashSkippedSectors;
+			return retVal;
+		}
+#endif
+
 		/* 2. Unlock the Control register */
 		retVal |= Flash_Unlock();
 		if(E_NOT_OK == retVal) {
 			return retVal;
 		}
 
-		/* 3. Set the SER bit */
-		FLASH->CR |= (1UL << 1);
+		/* 3. Clear the errors of an earlier operation, they would block this one */
+		FLASH->SR = FLASH_SR_ERRORS;
 
-		/* 4. Select the Sector to be erased */
-		FLASH->CR |= (uint32_t) (((uint32_t)Sector & 0x0000000F) << 3);
+		/* 4. Set the SER bit, the sector to be erased and the parallelism of the supply */
+		MODIFY_REG(FLASH->CR, FLASH_CR_PSIZE | FLASH_CR_SNB | FLASH_CR_PG,
+				(FLASH_ERASE_PARALLELISM << FLASH_PSIIZE_POS) | FLASH_CR_SER | (sectorNumber << FLASH_CR_SNB_Pos));
 
 		/* 5. Start the erase operation */
 		FLASH_START_OPERATION();
 
 		/* 6. Wait for the Flash to complete the operation */
 		FLASH_WAIT_FOR_COMPLETION();
+		CLEAR_BIT(FLASH->CR, FLASH_CR_SER | FLASH_CR_SNB);
+
+		/* 7. Check the result, the caches may hold the old content */
+		errors = FLASH->SR & FLASH_SR_ERRORS;
+		if(errors != 0) {
+			FLASH->SR = errors;
+			flashLastError = Flash_Decode_Errors(errors);
+			retVal |= E_NOT_OK;
+		}
+		else {
+			eraseFailed &= ~(1UL << sectorNumber);
+		}
+		FLASH_FlushCaches();
 
-		/* 7. Lock the Control register */
-		retVal |= Flash_Lock();
+		/* 8. Lock the Control register, unless a programming session keeps it open */
+		if(!flashSessionActive) {
+			retVal |= Flash_Lock();
+		}
 	}
 	return retVal;
 }
+
+/* One word at the program parallelism, little endian halfwords / bytes below x32 */
+static inline void Flash_Program_Word(volatile uint32_t *destination, uint32_t word)
+{
+#if (FLASH_PROGRAM_PARALLELISM == FLASH_PARALLELISM_32)
+	*destination = word;
+	FLASH_WAIT_FOR_COMPLETION();
+#elif (FLASH_PROGRAM_PARALLELISM == FLASH_PARALLELISM_16)
+	for(uint8_t i = 0; i < 2; ++i) {
+		((volatile uint16_t *)destination)[i] = (uint16_t)(word >> (16 * i));
+		FLASH_WAIT_FOR_COMPLETION();
+	}
+#else
+	for(uint8_t i = 0; i < 4; ++i) {
+		((volatile uint8_t *)destination)[i] = (uint8_t)(word >> (8 * i));
+		FLASH_WAIT_FOR_COMPLETION();
+	}
+#endif
+}
+
+/* FLASH->SR error flags to HAL_FLASH_ERROR_xxx bits */
+static uint32_t Flash_Decode_Errors(uint32_t status)
+{
+	uint32_t errors = HAL_FLASH_ERROR_NONE;
+
+	if(status & FLASH_SR_SOP) {
+		errors |= HAL_FLASH_ERROR_OPERATION;
+	}
+	if(status & FLASH_SR_WRPERR) {
+		errors |= HAL_FLASH_ERROR_WRP;
+	}
+	if(status & FLASH_SR_PGAERR) {
+		errors |= HAL_FLASH_ERROR_PGA;
+	}
+	if(status & FLASH_SR_PGPERR) {
+		errors |= HAL_FLASH_ERROR_PGP;
+	}
+	if(status & FLASH_SR_PGSERR) {
+		errors |= HAL_FLASH_ERROR_PGS;
+	}
+	if(status & FLASH_SR_RDERR) {
+		errors |= HAL_FLASH_ERROR_RD;
+	}
+	return errors;
+}
+
+/* Starts the lowest queued sector, interrupts masked or from the flash interrupt */
+static void Flash_Erase_Next(void)
+{
+	uint32_t sector = 0;
+
+	if(eraseQueue == 0) {
+		return;
+	}
+	while(!(eraseQueue & (1UL << sector))) {
+		sector++;
+	}
+	eraseQueue &= ~(1UL << sector);
+	eraseActiveSector = sector;
+
+	FLASH->SR = FLASH_SR_EOP | FLASH_SR_ERRORS;
+	MODIFY_REG(FLASH->CR, FLASH_CR_PSIZE | FLASH_CR_SNB | FLASH_CR_PG,
+			(FLASH_ERASE_PARALLELISM << FLASH_PSIIZE_POS) | FLASH_CR_SER | (sector << FLASH_CR_SNB_Pos)
+			| FLASH_CR_EOPIE | FLASH_CR_ERRIE);
+	FLASH_START_OPERATION();
+}
+
+/* Lets the sector being erased finish, and starts no other one */
+static void Flash_Erase_Hold(void)
+{
+	erasePaused = 1;
+	while(eraseActiveSector != FLASH_INVALID_SECTOR) {
+	}
+}
+
+/* Resumes the background erase with the next queued sector */
+static void Flash_Erase_Release(void)
+{
+	__disable_irq();
+	erasePaused = 0;
+	if(eraseActiveSector == FLASH_INVALID_SECTOR) {
+		Flash_Erase_Next();
+	}
+	__enable_irq();
+}
@@ -6,6 +6,13 @@
  ******************************************************************************
  */
 #include "helperFunctions/helperFunctions.h"
+#include "hostLink/hostLink.h"
+#include "Bootloader/Bootloader_Cfg.h"
+
+/* !< Set while a command is processed, the LED stays on */
+static volatile uint8_t statusLedBusy = 0;
+/* !< Milliseconds since the last toggle of the idle blink */
+static uint32_t statusLedTicks = 0;
 
 uint32_t convertWordToBigEndian(uint32_t word) {
     uint32_t reversedWord  = 0;
@@ -22,15 +29,35 @@ void turnLedOn(void) {
 void turnLedOff(void) {
 	HAL_GPIO_WritePin(GPIOC, GPIO_PIN_13, GPIO_PIN_SET);
 }
-HAL_StatusTypeDef sendToHost(uint8_t * message, uint8_t length) {
-	return HAL_UART_Transmit(BOOTLOADER_UART_OBJECT, message, length, HAL_MAX_DELAY);
+
+void setStatusLedBusy(uint8_t busy) {
+	statusLedBusy = busy;
+	if(busy) {
+		turnLedOn();
+	}
+}
+
+/* Called every millisecond from the SysTick interrupt */
+void updateStatusLed(void) {
+	if(statusLedBusy) {
+		statusLedTicks = 0;
+		return;
+	}
+	if(++statusLedTicks >= BL_LED_BLINK_PERIOD_MS) {
+		statusLedTicks = 0;
+		HAL_GPIO_TogglePin(GPIOC, GPIO_PIN_13);
+	}
+}
+HAL_StatusTypeDef sendToHost(uint8_t * message, uint32_t length) {
+	HostLink_Segment_t segment = { message, length };
+	return HostLink_Transmit(&segment, 1);
 }
 
-HAL_StatusTypeDef receiveFromHost(uint8_t * buffer, uint8_t length) {
-	return HAL_UART_Receive(BOOTLOADER_UART_OBJECT, buffer, length, HAL_MAX_DELAY);
+HAL_StatusTypeDef receiveFromHost(uint8_t * buffer, uint32_t length) {
+	return HostLink_Receive(buffer, length, HAL_MAX_DELAY);
 }
 
 void sendDebuggingMessage(uint8_t * message, uint8_t length) {
-	HAL_UART_Transmit(BOOTLOADER_UART_OBJECT, message, length, HAL_MAX_DELAY);
+	sendToHost(message, length);
 }
 
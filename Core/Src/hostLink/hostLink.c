@@ -0,0 +1,455 @@
+/**
+ ******************************************************************************
+ * @file           : hostLink.c
+ * @author         : Mostafa Asaad (https://github.com/M0stafa077)
+ * @brief          : Host UART link implementation.
+ *                   USART2 reception runs continuously into a circular DMA
+ *                   ring. The DMA half/full transfer events and the IDLE line
+ *                   event report the write position and assemble complete
+ *                   frames into a small pool of frame slots, so the next
+ *                   frame is received while the previous one is processed.
+ *                   Transmissions are gathered into one of two staging
+ *                   buffers and sent by DMA, one buffer is filled while the
+ *                   other one is on the wire.
+ ******************************************************************************
+ */
+
+/*---------------  Section: Includes --------------- */
+
+#include <string.h>
+#include "hostLink/hostLink.h"
+#include "helperFunctions/helperFunctions.h"
+
+/*---------------  Section: Private Macro Functions Declarations --------------- */
+
+/* !< The assembler runs from the UART/DMA interrupts and from thread mode */
+#define HOST_LINK_ENTER_CRITICAL()		uint32_t primask = __get_PRIMASK(); __disable_irq()
+#define HOST_LINK_EXIT_CRITICAL()		__set_PRIMASK(primask)
+
+/*---------------  Section: Private Variables --------------- */
+
+static uint8_t rxRingStorage[HOST_LINK_RX_RING_SIZE];
+static RingBuffer_t rxRing;
+
+static uint8_t frameSlots[HOST_LINK_FRAME_SLOTS][HOST_LINK_FRAME_SLOT_SIZE] __ALIGNED(4);
+static uint32_t frameSlotLength[HOST_LINK_FRAME_SLOTS];
+/* !< Free running counters, slot index = counter % HOST_LINK_FRAME_SLOTS */
+static volatile uint32_t framesAssembled = 0;
+static volatile uint32_t framesReleased = 0;
+static volatile uint32_t framesDropped = 0;
+/* !< Set while bytes are skipped to find the next frame start */
+static uint8_t rxResynchronising = 0;
+
+static uint8_t txBuffers[2][HOST_LINK_TX_BUFFER_SIZE] __ALIGNED(4);
+/* !< The staging buffer to fill next */
+static uint8_t txBufferIndex = 0;
+
+/* !< Tick of the last reception event, used to time out partial frames */
+static volatile uint32_t lastRxTick = 0;
+
+/*---------------  Section: Private Helper Function Declarations --------------- */
+
+static HAL_StatusTypeDef HostLink_Start_Reception(void);
+static void HostLink_Assemble_Frames(void);
+static void HostLink_Resynchronise(void);
+static uint32_t HostLink_Frame_Length(uint32_t pending);
+static uint32_t HostLink_Baud_Divider(uint32_t baudRate);
+static HAL_StatusTypeDef HostLink_Start_Transmission(uint32_t length);
+
+/*---------------  Section: Functions Definition --------------- */
+
+/**
+ * @brief  Starts the continuous DMA reception on the host UART.
+ * @retval HAL_StatusTypeDef: Status of the DMA start.
+ */
+HAL_StatusTypeDef HostLink_Init(void)
+{
+	framesAssembled = 0;
+	framesReleased = 0;
+	return HostLink_Start_Reception();
+}
+
+/**
+ * @brief  Stops the DMA reception, before handing the UART to the user app.
+ */
+void HostLink_DeInit(void)
+{
+	HostLink_Flush();
+	HAL_UART_Abort(BOOTLOADER_UART_OBJECT);
+	HAL_NVIC_DisableIRQ(DMA1_Stream5_IRQn);
+	HAL_NVIC_DisableIRQ(DMA1_Stream6_IRQn);
+}
+
+/**
+ * @brief  Returns the oldest assembled frame, without removing it.
+ *         Both the v1 and the v2 frame formats are accepted. The frame stays
+ *         valid until HostLink_Release_Frame() is called.
+ * @param  frameLength: Returns the frame length in bytes.
+ * @retval Pointer to the word aligned frame, NULL if no frame is complete.
+ */
+uint8_t *HostLink_Acquire_Frame(uint32_t *frameLength)
+{
+	uint32_t slot = 0;
+
+	/* Also catches partial frame timeouts when the line went quiet */
+	HOST_LINK_ENTER_CRITICAL();
+	HostLink_Assemble_Frames();
+	HOST_LINK_EXIT_CRITICAL();
+
+	if(framesAssembled == framesReleased) {
+		return NULL;
+	}
+	slot = framesReleased % HOST_LINK_FRAME_SLOTS;
+	*frameLength = frameSlotLength[slot];
+	return frameSlots[slot];
+}
+
+/**
+ * @brief  Tells whether an assembled frame is waiting, without assembling.
+ *         Safe to call with the interrupts disabled.
+ * @retval 1 if HostLink_Acquire_Frame() would return a frame, 0 otherwise.
+ */
+uint8_t HostLink_Frame_Pending(void)
+{
+	return (framesAssembled != framesReleased) ? 1 : 0;
+}
+
+/**
+ * @brief  Hands the acquired frame slot back to the assembler.
+ *         Frames held back in the ring while all slots were busy move in now.
+ */
+void HostLink_Release_Frame(void)
+{
+	if(framesAssembled != framesReleased) {
+		framesReleased++;
+	}
+
+	HOST_LINK_ENTER_CRITICAL();
+	HostLink_Assemble_Frames();
+	HOST_LINK_EXIT_CRITICAL();
+}
+
+/**
+ * @brief  Returns the number of frames dropped so far (line error,
+ *         overrun, invalid header or partial frame timeout). The bytes
+ *         skipped to find the next frame start count as one frame.
+ */
+uint32_t HostLink_Get_Dropped_Frames(void)
+{
+	return framesDropped;
+}
+
+/**
+ * @brief  Reads raw bytes from the reception ring.
+ *         Raw reads compete with the frame assembler, they are only meant
+ *         for exchanges where the host sends no frames.
+ * @param  buffer: Destination buffer.
+ * @param  length: The number of bytes to read.
+ * @param  timeout: Timeout in ms, HAL_MAX_DELAY to wait forever.
+ * @retval HAL_StatusTypeDef:
+ *         - HAL_OK: All bytes were read.
+ *         - HAL_TIMEOUT: Not enough bytes arrived in time, nothing was read.
+ */
+HAL_StatusTypeDef HostLink_Receive(uint8_t *buffer, uint32_t length, uint32_t timeout)
+{
+	uint32_t startTick = HAL_GetTick();
+
+	while(RingBuffer_Count(&rxRing) < length) {
+		if((timeout != HAL_MAX_DELAY) && ((HAL_GetTick() - startTick) > timeout)) {
+			return HAL_TIMEOUT;
+		}
+	}
+
+	HOST_LINK_ENTER_CRITICAL();
+	RingBuffer_Read(&rxRing, buffer, length);
+	HOST_LINK_EXIT_CRITICAL();
+	return HAL_OK;
+}
+
+/**
+ * @brief  Sends the segments back to back as one continuous transmission.
+ *         The segments are copied into a staging buffer and sent by DMA, so
+ *         they may live on the caller's stack. The call returns as soon as the
+ *         last part is queued; it only waits when both staging buffers are
+ *         busy. Transmissions larger than a staging buffer are split across
+ *         both buffers.
+ * @param  segments: The pieces to send, in order.
+ * @param  segmentCount: The number of segments.
+ * @retval HAL_StatusTypeDef: Status of the DMA start, HAL_TIMEOUT if the
+ *         previous transmission never completed.
+ */
+HAL_StatusTypeDef HostLink_Transmit(const HostLink_Segment_t *segments, uint32_t segmentCount)
+{
+	HAL_StatusTypeDef status = HAL_OK;
+	uint32_t filled = 0;
+	uint32_t chunk = 0;
+
+	for(uint32_t i = 0; (i < segmentCount) && (status == HAL_OK); ++i) {
+		const uint8_t *data = (const uint8_t *)segments[i].data;
+		uint32_t remaining = segments[i].length;
+
+		while((remaining > 0) && (status == HAL_OK)) {
+			chunk = HOST_LINK_TX_BUFFER_SIZE - filled;
+			if(chunk > remaining) {
+				chunk = remaining;
+			}
+			memcpy(&txBuffers[txBufferIndex][filled], data, chunk);
+			filled += chunk;
+			data += chunk;
+			remaining -= chunk;
+
+			if(filled == HOST_LINK_TX_BUFFER_SIZE) {
+				status = HostLink_Start_Transmission(filled);
+				filled = 0;
+			}
+		}
+	}
+
+	if((filled > 0) && (status == HAL_OK)) {
+		status = HostLink_Start_Transmission(filled);
+	}
+	return status;
+}
+
+/**
+ * @brief  Waits until the last byte queued by HostLink_Transmit() is on the wire.
+ * @retval HAL_StatusTypeDef: HAL_OK, or HAL_TIMEOUT if it never completed.
+ */
+HAL_StatusTypeDef HostLink_Flush(void)
+{
+	UART_HandleTypeDef *huart = BOOTLOADER_UART_OBJECT;
+	uint32_t startTick = HAL_GetTick();
+
+	/* The HAL returns to ready on the transmission complete (TC) event */
+	while(huart->gState != HAL_UART_STATE_READY) {
+		if((HAL_GetTick() - startTick) > HOST_LINK_TX_TIMEOUT_MS) {
+			return HAL_TIMEOUT;
+		}
+	}
+	return HAL_OK;
+}
+
+/**
+ * @brief  Returns the baud rate the host UART really runs at for a request.
+ *         The rate is derived from the current APB1 clock, using 16x
+ *         oversampling when possible and 8x oversampling otherwise.
+ * @param  baudRate: The requested baud rate.
+ * @retval The achievable baud rate, 0 if it deviates more than
+ *         HOST_LINK_MAX_BAUD_ERROR from the request or is out of range.
+ */
+uint32_t HostLink_Achievable_Baud_Rate(uint32_t baudRate)
+{
+	uint32_t divider = HostLink_Baud_Divider(baudRate);
+	uint32_t actual = 0;
+	uint32_t deviation = 0;
+
+	if(divider == 0) {
+		return 0;
+	}
+
+	actual = HAL_RCC_GetPCLK1Freq() / divider;
+	deviation = (actual > baudRate) ? (actual - baudRate) : (baudRate - actual);
+	if(((uint64_t)deviation * 1000U) > ((uint64_t)baudRate * HOST_LINK_MAX_BAUD_ERROR)) {
+		return 0;
+	}
+	return actual;
+}
+
+/**
+ * @brief  Switches the host UART to a new baud rate.
+ *         Any transmission must be complete. The reception restarts on an
+ *         empty ring, frames already in the slots are kept.
+ * @param  baudRate: The new baud rate, see HostLink_Achievable_Baud_Rate().
+ * @retval HAL_StatusTypeDef:
+ *         - HAL_OK: The UART runs at the new rate.
+ *         - HAL_ERROR: The rate is not achievable or the UART failed to restart.
+ */
+HAL_StatusTypeDef HostLink_Set_Baud_Rate(uint32_t baudRate)
+{
+	UART_HandleTypeDef *huart = BOOTLOADER_UART_OBJECT;
+	uint32_t divider = 0;
+
+	if(HostLink_Achievable_Baud_Rate(baudRate) == 0) {
+		return HAL_ERROR;
+	}
+	divider = HostLink_Baud_Divider(baudRate);
+
+	HostLink_Flush();
+	HAL_UART_Abort(huart);
+	huart->Init.BaudRate = baudRate;
+	huart->Init.OverSampling = (divider >= 16) ? UART_OVERSAMPLING_16 : UART_OVERSAMPLING_8;
+	if(HAL_UART_Init(huart) != HAL_OK) {
+		return HAL_ERROR;
+	}
+	return HostLink_Start_Reception();
+}
+
+/**
+ * @brief  Returns the configured host UART baud rate.
+ */
+uint32_t HostLink_Get_Baud_Rate(void)
+{
+	return (BOOTLOADER_UART_OBJECT)->Init.BaudRate;
+}
+
+/*---------------  Section: HAL Callbacks --------------- */
+
+/**
+ * @brief  Reception event from the DMA half/full transfer or the IDLE line.
+ * @param  Size: The current DMA write position in the ring.
+ */
+void HAL_UARTEx_RxEventCallback(UART_HandleTypeDef *huart, uint16_t Size)
+{
+	if(huart == BOOTLOADER_UART_OBJECT) {
+		RingBuffer_Produce(&rxRing, Size);
+		lastRxTick = HAL_GetTick();
+		HostLink_Assemble_Frames();
+	}
+}
+
+/**
+ * @brief  Line error (overrun, framing, noise) on the host UART.
+ *         Only blocking errors abort the DMA reception, which is restarted
+ *         here. The others are left for the frame CRC to catch.
+ */
+void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart)
+{
+	if((huart == BOOTLOADER_UART_OBJECT) && (huart->RxState == HAL_UART_STATE_READY)) {
+		if(RingBuffer_Count(&rxRing) != 0) {
+			framesDropped++;
+		}
+		HostLink_Start_Reception();
+	}
+}
+
+/*---------------  Section: Private Helper Function Definitions --------------- */
+
+static HAL_StatusTypeDef HostLink_Start_Reception(void)
+{
+	RingBuffer_Init(&rxRing, rxRingStorage, HOST_LINK_RX_RING_SIZE);
+	rxResynchronising = 0;
+	lastRxTick = HAL_GetTick();
+	return HAL_UARTEx_ReceiveToIdle_DMA(BOOTLOADER_UART_OBJECT, rxRingStorage,
+			HOST_LINK_RX_RING_SIZE);
+}
+
+/**
+ * @brief  Moves complete frames from the ring into the free frame slots.
+ *         Must run with the UART/DMA interrupts masked or from them.
+ *         When every slot is busy the frames wait in the ring, the write
+ *         window keeps the host from sending more than the ring holds.
+ */
+static void HostLink_Assemble_Frames(void)
+{
+	uint32_t pending = 0;
+	uint32_t length = 0;
+	uint32_t slot = 0;
+
+	if(RING_BUFFER_OVERRUN == RingBuffer_Take_Overrun(&rxRing)) {
+		/* The head lost its frame start, the frames behind it are whole */
+		HostLink_Resynchronise();
+	}
+
+	while((framesAssembled - framesReleased) < HOST_LINK_FRAME_SLOTS) {
+		pending = RingBuffer_Count(&rxRing);
+		if(pending == 0) {
+			break;
+		}
+
+		/* A bad header or a stale partial frame costs one byte, then the
+		 * header is parsed again, the frames queued behind are kept */
+		length = HostLink_Frame_Length(pending);
+		if(length > HOST_LINK_FRAME_SLOT_SIZE) {
+			HostLink_Resynchronise();
+			continue;
+		}
+
+		if(pending < length) {
+			if((HAL_GetTick() - lastRxTick) > HOST_LINK_FRAME_TIMEOUT_MS) {
+				HostLink_Resynchronise();
+				continue;
+			}
+			break;
+		}
+
+		slot = framesAssembled % HOST_LINK_FRAME_SLOTS;
+		frameSlotLength[slot] = RingBuffer_Read(&rxRing, frameSlots[slot], length);
+		framesAssembled++;
+		rxResynchronising = 0;
+	}
+}
+
+/**
+ * @brief  Returns the APB1 clock to baud rate divider (BRR / oversampling
+ *         granularity is one APB1 clock for both modes), 0 if too fast.
+ */
+static uint32_t HostLink_Baud_Divider(uint32_t baudRate)
+{
+	uint32_t divider = 0;
+
+	if(baudRate == 0) {
+		return 0;
+	}
+	divider = (HAL_RCC_GetPCLK1Freq() + (baudRate / 2)) / baudRate;
+
+	/* 8x oversampling needs a divider of at least 8 */
+	return (divider >= 8) ? divider : 0;
+}
+
+/**
+ * @brief  Sends the filled staging buffer and switches to the other one.
+ *         Waits for the previous transmission, which used the other buffer.
+ */
+static HAL_StatusTypeDef HostLink_Start_Transmission(uint32_t length)
+{
+	HAL_StatusTypeDef status = HostLink_Flush();
+
+	if(status == HAL_OK) {
+		status = HAL_UART_Transmit_DMA(BOOTLOADER_UART_OBJECT, txBuffers[txBufferIndex], (uint16_t)length);
+		txBufferIndex ^= 1;
+	}
+	return status;
+}
+
+/**
+ * @brief  Skips the byte at the head of the ring, the next one may start a
+ *         frame. A run of skipped bytes counts as one dropped frame.
+ */
+static void HostLink_Resynchronise(void)
+{
+	RingBuffer_Discard(&rxRing, 1);
+	if(!rxResynchronising) {
+		rxResynchronising = 1;
+		framesDropped++;
+	}
+}
+
+/**
+ * @brief  Returns the total length of the frame at the head of the ring.
+ *         Must only be called with at least one pending byte.
+ *         An invalid header returns UINT32_MAX so the byte gets skipped.
+ */
+static uint32_t HostLink_Frame_Length(uint32_t pending)
+{
+	uint32_t payloadLength = 0;
+
+	if(RingBuffer_Peek(&rxRing, 0) != HOST_LINK_FRAME_V2_MARKER) {
+		/* v1: Length byte followed by N bytes */
+		if(RingBuffer_Peek(&rxRing, 0) < HOST_LINK_FRAME_V1_MIN_LENGTH) {
+			return UINT32_MAX;
+		}
+		return (uint32_t)RingBuffer_Peek(&rxRing, 0) + 1;
+	}
+
+	if(pending < HOST_LINK_FRAME_V2_HEADER_SIZE) {
+		/* Wait for the rest of the header */
+		return HOST_LINK_FRAME_V2_HEADER_SIZE;
+	}
+
+	payloadLength = (uint32_t)RingBuffer_Peek(&rxRing, 2)
+			| ((uint32_t)RingBuffer_Peek(&rxRing, 3) << 8);
+	if((payloadLength % 4) != 0) {
+		return UINT32_MAX;
+	}
+	return HOST_LINK_FRAME_V2_HEADER_SIZE + payloadLength + HOST_LINK_FRAME_CRC_SIZE;
+}
@@ -0,0 +1,127 @@
+/**
+ ******************************************************************************
+ * @file           : ringBuffer.c
+ * @author         : Mostafa Asaad (https://github.com/M0stafa077)
+ * @brief          : Single producer / single consumer byte ring implementation
+ ******************************************************************************
+ */
+
+/*---------------  Section: Includes --------------- */
+
+#include <string.h>
+#include "ringBuffer/ringBuffer.h"
+
+/*---------------  Section: Functions Definition --------------- */
+
+/**
+ * @brief  Initializes an empty ring over the given storage.
+ * @param  ring: The ring object.
+ * @param  storage: Backing storage, shared with the producer (e.g. the DMA).
+ * @param  size: Storage size in bytes, must be a power of two.
+ */
+void RingBuffer_Init(RingBuffer_t *ring, uint8_t *storage, uint32_t size)
+{
+	ring->storage = storage;
+	ring->size = size;
+	ring->writeIndex = 0;
+	ring->produced = 0;
+	ring->consumed = 0;
+	ring->overrun = 0;
+}
+
+/**
+ * @brief  Reports the new producer position.
+ *         The position is where the producer will write next, in [0, size].
+ *         A position equal to size means the producer just wrapped.
+ *         Consecutive reports must be less than a full lap apart, which holds
+ *         for a circular DMA reporting at least its half and full transfer
+ *         events.
+ * @param  ring: The ring object.
+ * @param  position: The current producer position.
+ */
+void RingBuffer_Produce(RingBuffer_t *ring, uint32_t position)
+{
+	uint32_t mask = ring->size - 1;
+	uint32_t advance = (position - ring->writeIndex) & mask;
+
+	if((advance == 0) && (position == ring->size) && (ring->writeIndex == 0)) {
+		/* A full lap without an intermediate report */
+		advance = ring->size;
+	}
+
+	ring->writeIndex = position & mask;
+	ring->produced += advance;
+
+	if((ring->produced - ring->consumed) > ring->size) {
+		/* The oldest bytes were overwritten, keep only the latest lap */
+		ring->consumed = ring->produced - ring->size;
+		ring->overrun = 1;
+	}
+}
+
+/**
+ * @brief  Returns the number of bytes waiting to be consumed.
+ */
+uint32_t RingBuffer_Count(const RingBuffer_t *ring)
+{
+	return ring->produced - ring->consumed;
+}
+
+/**
+ * @brief  Returns a pending byte without consuming it.
+ * @param  offset: Offset from the oldest pending byte, must be below the count.
+ */
+uint8_t RingBuffer_Peek(const RingBuffer_t *ring, uint32_t offset)
+{
+	return ring->storage[(ring->consumed + offset) & (ring->size - 1)];
+}
+
+/**
+ * @brief  Copies and consumes up to length pending bytes.
+ * @param  ring: The ring object.
+ * @param  destination: Where to copy the bytes.
+ * @param  length: The maximum number of bytes to read.
+ * @retval The number of bytes actually read.
+ */
+uint32_t RingBuffer_Read(RingBuffer_t *ring, uint8_t *destination, uint32_t length)
+{
+	uint32_t available = RingBuffer_Count(ring);
+	uint32_t readIndex = ring->consumed & (ring->size - 1);
+	uint32_t firstChunk = 0;
+
+	if(length > available) {
+		length = available;
+	}
+
+	/* Copy up to the end of the storage, then the wrapped part */
+	firstChunk = ring->size - readIndex;
+	if(firstChunk > length) {
+		firstChunk = length;
+	}
+	memcpy(destination, &ring->storage[readIndex], firstChunk);
+	memcpy(&destination[firstChunk], ring->storage, length - firstChunk);
+
+	ring->consumed += length;
+	return length;
+}
+
+/**
+ * @brief  Consumes up to length pending bytes without copying them.
+ */
+void RingBuffer_Discard(RingBuffer_t *ring, uint32_t length)
+{
+	uint32_t available = RingBuffer_Count(ring);
+	ring->consumed += (length > available) ? available : length;
+}
+
+/**
+ * @brief  Returns and clears the overrun indication.
+ * @retval RING_BUFFER_OVERRUN if bytes were lost since the last call,
+ *         RING_BUFFER_OK otherwise.
+ */
+uint8_t RingBuffer_Take_Overrun(RingBuffer_t *ring)
+{
+	uint8_t overrun = ring->overrun;
+	ring->overrun = 0;
+	return overrun ? RING_BUFFER_OVERRUN : RING_BUFFER_OK;
+}
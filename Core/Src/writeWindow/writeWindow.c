@@ -0,0 +1,75 @@
+/**
+ ******************************************************************************
+ * @file           : writeWindow.c
+ * @author         : Mostafa Asaad (https://github.com/M0stafa077)
+ * @brief          : Receiver side bookkeeping of the pipelined write protocol
+ ******************************************************************************
+ */
+
+/*---------------  Section: Includes --------------- */
+
+#include "writeWindow/writeWindow.h"
+
+/*---------------  Section: Functions Definition --------------- */
+
+/**
+ * @brief  Restarts the window at sequence number 0.
+ * @param  window: The window object.
+ * @param  windowSize: The proposed window, capped to [1, WRITE_WINDOW_MAX_SIZE].
+ * @retval The granted window.
+ */
+uint16_t WriteWindow_Init(WriteWindow_t *window, uint32_t windowSize)
+{
+	if(windowSize == 0) {
+		windowSize = 1;
+	}
+	else if(windowSize > WRITE_WINDOW_MAX_SIZE) {
+		windowSize = WRITE_WINDOW_MAX_SIZE;
+	}
+
+	window->windowSize = (uint16_t)windowSize;
+	window->baseSequence = 0;
+	window->receivedMask = 0;
+	window->nackedMask = 0;
+	return window->windowSize;
+}
+
+/**
+ * @brief  Tells whether a frame still has to be programmed.
+ *         Sequence numbers wrap, the window is counted from baseSequence.
+ * @retval WRITE_WINDOW_NEW or WRITE_WINDOW_DUPLICATE.
+ */
+uint8_t WriteWindow_Classify(const WriteWindow_t *window, uint16_t sequence)
+{
+	uint16_t offset = (uint16_t)(sequence - window->baseSequence);
+
+	if((offset >= window->windowSize) || (window->receivedMask & (1UL << offset))) {
+		return WRITE_WINDOW_DUPLICATE;
+	}
+	return WRITE_WINDOW_NEW;
+}
+
+/**
+ * @brief  Records a programmed WRITE_WINDOW_NEW frame, then slides the
+ *         window over the in-order prefix.
+ * @param  window: The window object.
+ * @param  sequence: The frame sequence number.
+ * @retval The frames skipped before this one and not NACKed yet, bit i for
+ *         baseSequence + i. They are marked NACKed. When there are any the
+ *         window can't slide, so baseSequence still numbers them.
+ */
+uint32_t WriteWindow_Receive(WriteWindow_t *window, uint16_t sequence)
+{
+	uint16_t offset = (uint16_t)(sequence - window->baseSequence);
+	uint32_t gaps = ((1UL << offset) - 1) & ~window->receivedMask & ~window->nackedMask;
+
+	window->receivedMask |= (1UL << offset);
+	window->nackedMask |= gaps;
+
+	while(window->receivedMask & 1UL) {
+		window->receivedMask >>= 1;
+		window->nackedMask >>= 1;
+		window->baseSequence++;
+	}
+	return gaps;
+}
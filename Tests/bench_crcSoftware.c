@@ -0,0 +1,103 @@
+/**
+ ******************************************************************************
+ * @file           : bench_crcSoftware.c
+ * @author         : Mostafa Asaad (https://github.com/M0stafa077)
+ * @brief          : Host benchmark of the software CRC word kernels, run
+ *                   with "make -C Tests bench". Prints the MB/s of every
+ *                   kernel on buffers from 64 B to 64 KB. Host figures
+ *                   rank the kernels, the on target cycles come from the
+ *                   bootloader's own benchmark.
+ ******************************************************************************
+ */
+
+/*---------------  Section: Includes --------------- */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "crcServices/crcSoftware.h"
+
+/*---------------  Section: Macros Declarations --------------- */
+
+#define BENCH_MAX_SIZE					65536U
+#define BENCH_SECONDS					0.1
+
+/*---------------  Section: Types Declarations --------------- */
+
+typedef uint32_t (* Bench_Kernel_t) (uint32_t crc, const uint32_t *words, uint32_t wordCount);
+
+/*---------------  Section: Global Variables --------------- */
+
+static const Bench_Kernel_t kernels[] = {
+	Crc_Bitwise_Words, Crc_Table_Words, Crc_Slice4_Words, Crc_Slice8_Words
+};
+static const char *const kernelNames[] = { "bitwise", "table", "slice4", "slice8" };
+static const uint32_t sizes[] = { 64, 1024, 4096, 16384, BENCH_MAX_SIZE };
+
+static uint32_t words[BENCH_MAX_SIZE / 4];
+
+/*---------------  Section: Helper Functions --------------- */
+
+static double Bench_Seconds(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double)now.tv_sec + ((double)now.tv_nsec * 1e-9);
+}
+
+/* Runs the kernel over the buffer for BENCH_SECONDS, returns the MB/s */
+static double Bench_Kernel(Bench_Kernel_t kernel, uint32_t size, uint32_t *crc)
+{
+	double start = Bench_Seconds();
+	double elapsed = 0;
+	uint32_t rounds = 0;
+
+	do {
+		*crc = kernel(CRC_SOFTWARE_INIT, words, size / 4);
+		rounds++;
+		elapsed = Bench_Seconds() - start;
+	} while(elapsed < BENCH_SECONDS);
+
+	return ((double)size * rounds) / (elapsed * 1e6);
+}
+
+int main(void)
+{
+	uint32_t reference = 0;
+	uint32_t crc = 0;
+	uint32_t mismatches = 0;
+
+	srand(1);
+	for(uint32_t i = 0; i < (sizeof(words) / sizeof(words[0])); ++i) {
+		words[i] = ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+	}
+
+	/* The tables are built outside the timed runs */
+	for(uint32_t k = 0; k < (sizeof(kernels) / sizeof(kernels[0])); ++k) {
+		kernels[k](CRC_SOFTWARE_INIT, words, 1);
+	}
+
+	printf("%8s", "bytes");
+	for(uint32_t k = 0; k < (sizeof(kernels) / sizeof(kernels[0])); ++k) {
+		printf(" %10s", kernelNames[k]);
+	}
+	printf("   (MB/s)\n");
+
+	for(uint32_t s = 0; s < (sizeof(sizes) / sizeof(sizes[0])); ++s) {
+		printf("%8lu", (unsigned long)sizes[s]);
+		for(uint32_t k = 0; k < (sizeof(kernels) / sizeof(kernels[0])); ++k) {
+			printf(" %10.1f", Bench_Kernel(kernels[k], sizes[s], &crc));
+			if(k == 0) {
+				reference = crc;
+			}
+			mismatches += (crc != reference);
+		}
+		printf("\n");
+	}
+
+	if(mismatches != 0) {
+		printf("bench_crcSoftware: %lu kernel results differ\n", (unsigned long)mismatches);
+	}
+	return (mismatches == 0) ? 0 : 1;
+}
@@ -0,0 +1,139 @@
+/**
+ ******************************************************************************
+ * @file           : test_command_latency.c
+ * @author         : Mostafa Asaad (https://github.com/M0stafa077)
+ * @brief          : Host simulation of the per command end to end latency,
+ *                   the fixed 500 ms loop pause against the event driven
+ *                   loop. The event driven side runs the receive ring fed by
+ *                   a mocked UART DMA: a frame is handled once its IDLE
+ *                   event shows it complete in the ring.
+ *
+ *                   The model, per command (stop and wait, as the host tool):
+ *                   - the host adapter latency, each way,
+ *                   - the frame and the reply at 10 bits a byte,
+ *                   - the IDLE event one character after the last byte,
+ *                   - a fixed handling time on the device.
+ ******************************************************************************
+ */
+
+/*---------------  Section: Includes --------------- */
+
+#include <stdio.h>
+#include "ringBuffer/ringBuffer.h"
+
+/*---------------  Section: Macros Declarations --------------- */
+
+#define TEST_CHECK(condition)			Test_Check((condition), #condition, __LINE__)
+
+#define SIM_RING_SIZE					8192U
+#define SIM_LATENCY_S					1e-3	/* !< Host adapter latency, each way */
+#define SIM_HANDLING_S					50e-6	/* !< Dispatch and a short command */
+#define SIM_WAKE_S						2e-6	/* !< Interrupt, WFI exit and frame check */
+#define SIM_LOOP_PAUSE_S				0.5		/* !< The removed HAL_Delay(500) */
+#define SIM_REPLY_SIZE					2U
+
+/*---------------  Section: Global Variables --------------- */
+
+/* !< A session: version, help, chip ID, then v1 writes and a jump */
+static const uint32_t commandSizes[] = { 6, 6, 6, 255, 255, 255, 255, 255, 255, 255, 255, 136, 6 };
+
+static uint8_t storage[SIM_RING_SIZE];
+static RingBuffer_t ring;
+static uint32_t dmaPosition;
+static uint32_t failures;
+
+/*---------------  Section: Helper Functions --------------- */
+
+static void Test_Check(int condition, const char *text, int line)
+{
+	if(!condition) {
+		printf("FAIL line %d: %s\n", line, text);
+		failures++;
+	}
+}
+
+/* The UART receives a v1 frame, then the line goes idle */
+static void Mock_Uart_Receive_Frame(uint32_t length)
+{
+	for(uint32_t i = 0; i < length; ++i) {
+		storage[dmaPosition] = (i == 0) ? (uint8_t)(length - 1) : (uint8_t)i;
+		dmaPosition++;
+		if((dmaPosition == (SIM_RING_SIZE / 2)) || (dmaPosition == SIM_RING_SIZE)) {
+			RingBuffer_Produce(&ring, dmaPosition);
+			dmaPosition %= SIM_RING_SIZE;
+		}
+	}
+	RingBuffer_Produce(&ring, dmaPosition);
+}
+
+/* The frame at the head of the ring is complete */
+static uint8_t Sim_Frame_Complete(void)
+{
+	return (RingBuffer_Count(&ring) > 0)
+			&& (RingBuffer_Count(&ring) >= ((uint32_t)RingBuffer_Peek(&ring, 0) + 1));
+}
+
+/**
+ * Runs the session, returns the mean command latency in seconds: from the
+ * host starting the command to the host holding the whole reply.
+ */
+static double Sim_Session(double baudRate, uint8_t eventDriven)
+{
+	const double charTime = 10.0 / baudRate;
+	double hostStart = 0;
+	double frameReceived = 0;
+	double handled = 0;
+	double replyReceived = 0;
+	double deviceFree = 0;
+	double total = 0;
+	uint32_t count = sizeof(commandSizes) / sizeof(commandSizes[0]);
+
+	RingBuffer_Init(&ring, storage, sizeof(storage));
+	dmaPosition = 0;
+
+	for(uint32_t i = 0; i < count; ++i) {
+		frameReceived = hostStart + SIM_LATENCY_S + (commandSizes[i] * charTime);
+
+		if(eventDriven) {
+			/* Woken by the IDLE event, the ring holds the whole frame */
+			Mock_Uart_Receive_Frame(commandSizes[i]);
+			TEST_CHECK(Sim_Frame_Complete());
+			handled = frameReceived + charTime + SIM_WAKE_S;
+			RingBuffer_Discard(&ring, commandSizes[i]);
+		}
+		else {
+			/* The frame is only read once the pause after the last command ends */
+			handled = (frameReceived > deviceFree) ? frameReceived : deviceFree;
+		}
+		handled += SIM_HANDLING_S;
+		deviceFree = handled + (eventDriven ? 0 : SIM_LOOP_PAUSE_S);
+
+		replyReceived = handled + (SIM_REPLY_SIZE * charTime) + SIM_LATENCY_S;
+		total += replyReceived - hostStart;
+		hostStart = replyReceived;
+	}
+	return total / count;
+}
+
+int main(void)
+{
+	const double baudRates[] = { 115200, 921600, 3000000 };
+	double paused = 0;
+	double evented = 0;
+
+	printf("Mean command latency over a %u command session, in ms\n",
+			(unsigned)(sizeof(commandSizes) / sizeof(commandSizes[0])));
+	printf("%9s %14s %14s\n", "baud", "500 ms pause", "event driven");
+	for(uint32_t b = 0; b < (sizeof(baudRates) / sizeof(baudRates[0])); ++b) {
+		paused = Sim_Session(baudRates[b], 0);
+		evented = Sim_Session(baudRates[b], 1);
+		printf("%9.0f %14.2f %14.2f\n", baudRates[b], paused * 1e3, evented * 1e3);
+
+		/* The pause is gone: what remains is the wire, the adapter and the IDLE character */
+		TEST_CHECK(evented < (paused - 0.4));
+		TEST_CHECK(evented < (2 * SIM_LATENCY_S + (260 * 10.0 / baudRates[b]) + 1e-3));
+	}
+
+	printf("test_command_latency: %s\n", (failures == 0) ? "PASS" : "FAIL");
+	return (failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,282 @@
+/**
+ ******************************************************************************
+ * @file           : test_compression_decode.c
+ * @author         : Mostafa Asaad (https://github.com/M0stafa077)
+ * @brief          : Host test of Compression_Decode() on hand built RLE and
+ *                   LZ4 blocks, decoded through a staging buffer much smaller
+ *                   than the block so the LZ4 matches reach back into the
+ *                   flushed output, and across blocks. Also reports the
+ *                   decode throughput on the host.
+ ******************************************************************************
+ */
+
+/*---------------  Section: Includes --------------- */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "compression/compression.h"
+
+/*---------------  Section: Macros Declarations --------------- */
+
+#define TEST_IMAGE_SIZE					49152U
+/* !< As BL_DECODE_STAGING_SIZE */
+#define TEST_STAGING_SIZE				256U
+#define TEST_BENCH_SECONDS				0.2
+
+#define TEST_CHECK(condition)			Test_Check((condition), #condition, __LINE__)
+
+/*---------------  Section: Global Variables --------------- */
+
+static uint8_t expectedImage[TEST_IMAGE_SIZE];
+static uint8_t decodedImage[TEST_IMAGE_SIZE];
+static uint8_t staging[TEST_STAGING_SIZE];
+static uint8_t block[2 * TEST_IMAGE_SIZE];
+static uint32_t blockLength;
+static uint32_t expectedLength;
+static uint32_t failures;
+
+/*---------------  Section: Helper Functions --------------- */
+
+static void Test_Check(int condition, const char *text, int line)
+{
+	if(!condition) {
+		printf("FAIL line %d: %s\n", line, text);
+		failures++;
+	}
+}
+
+/* Flash stand-in: programs the flushed bytes where the decoder reads them back */
+static uint8_t Test_Sink(uint32_t offset, const uint8_t *data, uint32_t length)
+{
+	if((offset + length) > sizeof(decodedImage)) {
+		return 1;
+	}
+	memcpy(&decodedImage[offset], data, length);
+	return 0;
+}
+
+static void Test_Block_Reset(void)
+{
+	blockLength = 0;
+	expectedLength = 0;
+}
+
+static void Test_Rle_Run(uint8_t value, uint32_t count)
+{
+	uint32_t chunk = 0;
+
+	memset(&expectedImage[expectedLength], value, count);
+	expectedLength += count;
+	while(count > 0) {
+		chunk = (count > 128) ? 128 : count;
+		block[blockLength++] = (uint8_t)(0x80 | (chunk - 1));
+		block[blockLength++] = value;
+		count -= chunk;
+	}
+}
+
+static void Test_Rle_Copy(const uint8_t *data, uint32_t count)
+{
+	uint32_t chunk = 0;
+
+	memcpy(&expectedImage[expectedLength], data, count);
+	expectedLength += count;
+	while(count > 0) {
+		chunk = (count > 128) ? 128 : count;
+		block[blockLength++] = (uint8_t)(chunk - 1);
+		memcpy(&block[blockLength], data, chunk);
+		blockLength += chunk;
+		data += chunk;
+		count -= chunk;
+	}
+}
+
+static void Test_Lz4_Length(uint32_t length)
+{
+	while(length >= 255) {
+		block[blockLength++] = 255;
+		length -= 255;
+	}
+	block[blockLength++] = (uint8_t)length;
+}
+
+/* One sequence, matchLength 0 for the last one (literals only) */
+static void Test_Lz4_Sequence(const uint8_t *literals, uint32_t literalLength, uint32_t offset, uint32_t matchLength)
+{
+	uint32_t matchCode = (matchLength == 0) ? 0 : (matchLength - 4);
+
+	block[blockLength++] = (uint8_t)(((literalLength < 15) ? literalLength : 15) << 4)
+			| (uint8_t)((matchCode < 15) ? matchCode : 15);
+	if(literalLength >= 15) {
+		Test_Lz4_Length(literalLength - 15);
+	}
+	memcpy(&block[blockLength], literals, literalLength);
+	blockLength += literalLength;
+	memcpy(&expectedImage[expectedLength], literals, literalLength);
+	expectedLength += literalLength;
+
+	if(matchLength == 0) {
+		return;
+	}
+	block[blockLength++] = (uint8_t)offset;
+	block[blockLength++] = (uint8_t)(offset >> 8);
+	if(matchCode >= 15) {
+		Test_Lz4_Length(matchCode - 15);
+	}
+	/* Byte by byte, overlapping matches repeat the last offset bytes */
+	for(uint32_t i = 0; i < matchLength; ++i, ++expectedLength) {
+		expectedImage[expectedLength] = expectedImage[expectedLength - offset];
+	}
+}
+
+/* Firmware like data: short literal runs, matches near and far (up to 32 KB back) */
+static void Test_Lz4_Image(uint32_t size, uint32_t *split)
+{
+	uint8_t literals[64];
+	uint32_t literalLength = 0;
+	uint32_t offset = 0;
+	uint32_t matchLength = 0;
+
+	srand(1);
+	Test_Block_Reset();
+	while(expectedLength < (size - 400)) {
+		if((*split == 0) && (expectedLength >= (size / 2))) {
+			*split = blockLength;
+		}
+		literalLength = 1 + (uint32_t)(rand() % 40);
+		for(uint32_t i = 0; i < literalLength; ++i) {
+			literals[i] = (uint8_t)rand();
+		}
+		offset = expectedLength + literalLength;
+		switch(rand() % 4) {
+			case 0:
+				offset = 1 + (uint32_t)(rand() % 4);					/* Overlapping */
+				break;
+			case 1:
+				offset = 1 + (uint32_t)(rand() % (offset < 32768 ? offset : 32768));
+				break;
+			default:
+				offset = 1 + (uint32_t)(rand() % (offset < 1024 ? offset : 1024));
+				break;
+		}
+		matchLength = 4 + (uint32_t)(rand() % ((rand() % 8) ? 40 : 300));
+		Test_Lz4_Sequence(literals, literalLength, offset, matchLength);
+	}
+	Test_Lz4_Sequence(literals, 5, 0, 0);
+}
+
+static void Test_Output_Init(Compression_Output_t *output, uint32_t limit)
+{
+	memset(decodedImage, 0xFF, sizeof(decodedImage));
+	Compression_Output_Init(output, staging, sizeof(staging), decodedImage, limit, Test_Sink);
+}
+
+static double Test_Seconds(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double)now.tv_sec + ((double)now.tv_nsec * 1e-9);
+}
+
+/* Decodes the block over and over, returns the decoded MB/s */
+static double Test_Throughput(uint8_t encoding)
+{
+	Compression_Output_t output;
+	double start = Test_Seconds();
+	double elapsed = 0;
+	uint32_t rounds = 0;
+
+	do {
+		Compression_Output_Init(&output, staging, sizeof(staging), decodedImage, sizeof(decodedImage), Test_Sink);
+		Compression_Decode(&output, encoding, block, blockLength);
+		Compression_Output_Finish(&output);
+		rounds++;
+		elapsed = Test_Seconds() - start;
+	} while(elapsed < TEST_BENCH_SECONDS);
+
+	return ((double)expectedLength * rounds) / (elapsed * 1e6);
+}
+
+/*---------------  Section: Tests --------------- */
+
+static void Test_Decode_RLE(void)
+{
+	Compression_Output_t output;
+	uint8_t data[300];
+
+	for(uint32_t i = 0; i < sizeof(data); ++i) {
+		data[i] = (uint8_t)(i * 31);
+	}
+
+	Test_Block_Reset();
+	while(expectedLength < (TEST_IMAGE_SIZE - 2000)) {
+		Test_Rle_Run(0xFF, 1 + (expectedLength % 700));			/* Erased gaps, runs over 128 */
+		Test_Rle_Copy(data, 1 + (expectedLength % sizeof(data)));
+		Test_Rle_Run(0x00, 3);
+	}
+
+	Test_Output_Init(&output, TEST_IMAGE_SIZE);
+	TEST_CHECK(Compression_Decode(&output, COMPRESSION_RLE, block, blockLength) == COMPRESSION_OK);
+	TEST_CHECK(Compression_Output_Finish(&output) == COMPRESSION_OK);
+	TEST_CHECK(Compression_Output_Length(&output) == expectedLength);
+	TEST_CHECK(memcmp(decodedImage, expectedImage, expectedLength) == 0);
+
+	/* A repeat without its byte, a copy past the end */
+	Test_Output_Init(&output, TEST_IMAGE_SIZE);
+	TEST_CHECK(Compression_Decode(&output, COMPRESSION_RLE, (const uint8_t *)"\x85", 1) == COMPRESSION_CORRUPT);
+	TEST_CHECK(Compression_Decode(&output, COMPRESSION_RLE, (const uint8_t *)"\x05\x01\x02", 3) == COMPRESSION_CORRUPT);
+
+	printf("RLE: %lu -> %lu bytes, %.1f MB/s decoded\n", (unsigned long)blockLength,
+			(unsigned long)expectedLength, Test_Throughput(COMPRESSION_RLE));
+}
+
+static void Test_Decode_LZ4(void)
+{
+	Compression_Output_t output;
+	uint32_t split = 0;
+
+	Test_Lz4_Image(TEST_IMAGE_SIZE, &split);
+	TEST_CHECK(expectedLength <= TEST_IMAGE_SIZE);
+
+	/* One block */
+	Test_Output_Init(&output, TEST_IMAGE_SIZE);
+	TEST_CHECK(Compression_Decode(&output, COMPRESSION_LZ4, block, blockLength) == COMPRESSION_OK);
+	TEST_CHECK(Compression_Output_Finish(&output) == COMPRESSION_OK);
+	TEST_CHECK(Compression_Output_Length(&output) == expectedLength);
+	TEST_CHECK(memcmp(decodedImage, expectedImage, expectedLength) == 0);
+
+	/* Two blocks of one stream, the second matching into the first */
+	Test_Output_Init(&output, TEST_IMAGE_SIZE);
+	TEST_CHECK(Compression_Decode(&output, COMPRESSION_LZ4, block, split) == COMPRESSION_OK);
+	TEST_CHECK(Compression_Decode(&output, COMPRESSION_LZ4, &block[split], blockLength - split) == COMPRESSION_OK);
+	TEST_CHECK(Compression_Output_Finish(&output) == COMPRESSION_OK);
+	TEST_CHECK(memcmp(decodedImage, expectedImage, expectedLength) == 0);
+
+	/* Without a readable sink, matches stop at the staging buffer */
+	Compression_Output_Init(&output, staging, sizeof(staging), NULL, TEST_IMAGE_SIZE, Test_Sink);
+	TEST_CHECK(Compression_Decode(&output, COMPRESSION_LZ4, block, blockLength) == COMPRESSION_CORRUPT);
+
+	/* Output limit, truncated block, match before the start of the output */
+	Test_Output_Init(&output, expectedLength - 1);
+	TEST_CHECK(Compression_Decode(&output, COMPRESSION_LZ4, block, blockLength) == COMPRESSION_OVERFLOW);
+	Test_Output_Init(&output, TEST_IMAGE_SIZE);
+	TEST_CHECK(Compression_Decode(&output, COMPRESSION_LZ4, block, 3) == COMPRESSION_CORRUPT);
+	Test_Output_Init(&output, TEST_IMAGE_SIZE);
+	TEST_CHECK(Compression_Decode(&output, COMPRESSION_LZ4, (const uint8_t *)"\x10\x41\x02\x00", 4)
+			== COMPRESSION_CORRUPT);
+
+	printf("LZ4: %lu -> %lu bytes, %.1f MB/s decoded\n", (unsigned long)blockLength,
+			(unsigned long)expectedLength, Test_Throughput(COMPRESSION_LZ4));
+}
+
+int main(void)
+{
+	Test_Decode_RLE();
+	Test_Decode_LZ4();
+
+	printf("test_compression_decode: %s\n", (failures == 0) ? "PASS" : "FAIL");
+	return (failures == 0) ? 0 : 1;
+}
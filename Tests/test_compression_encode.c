@@ -0,0 +1,282 @@
+/**
+ ******************************************************************************
+ * @file           : test_compression_encode.c
+ * @author         : Mostafa Asaad (https://github.com/M0stafa077)
+ * @brief          : Host round trip test of Compression_Encode(): every
+ *                   encoded block decodes back through Compression_Decode(),
+ *                   the LZ4 blocks keep the end of block rules, and blocks
+ *                   that don't shrink are left to go raw. Reports the ratio
+ *                   and the encode / decode throughput on the host.
+ ******************************************************************************
+ */
+
+/*---------------  Section: Includes --------------- */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "compression/compression.h"
+
+/*---------------  Section: Macros Declarations --------------- */
+
+#define TEST_BLOCK_SIZE					COMPRESSION_LZ4_MAX_BLOCK
+/* !< RLE worst case: one control byte per 128 literals */
+#define TEST_ENCODED_SIZE				(TEST_BLOCK_SIZE + (TEST_BLOCK_SIZE / 128) + 16)
+#define TEST_STAGING_SIZE				256U
+#define TEST_BENCH_SECONDS				0.2
+
+#define TEST_CHECK(condition)			Test_Check((condition), #condition, __LINE__)
+
+/*---------------  Section: Global Variables --------------- */
+
+static uint8_t input[TEST_BLOCK_SIZE + 1];
+static uint8_t encoded[TEST_ENCODED_SIZE];
+static uint8_t decoded[TEST_BLOCK_SIZE + 1];
+static uint8_t staging[TEST_STAGING_SIZE];
+static uint32_t failures;
+
+/*---------------  Section: Helper Functions --------------- */
+
+static void Test_Check(int condition, const char *text, int line)
+{
+	if(!condition) {
+		printf("FAIL line %d: %s\n", line, text);
+		failures++;
+	}
+}
+
+static uint8_t Test_Sink(uint32_t offset, const uint8_t *data, uint32_t length)
+{
+	if((offset + length) > sizeof(decoded)) {
+		return 1;
+	}
+	memcpy(&decoded[offset], data, length);
+	return 0;
+}
+
+static double Test_Seconds(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double)now.tv_sec + ((double)now.tv_nsec * 1e-9);
+}
+
+/* Decodes the block and compares it with the first length bytes of the input */
+static uint8_t Test_Round_Trip(uint8_t encoding, uint32_t encodedLength, uint32_t length)
+{
+	Compression_Output_t output;
+
+	memset(decoded, 0xA5, sizeof(decoded));
+	Compression_Output_Init(&output, staging, sizeof(staging), decoded, length, Test_Sink);
+	return (Compression_Decode(&output, encoding, encoded, encodedLength) == COMPRESSION_OK)
+			&& (Compression_Output_Finish(&output) == COMPRESSION_OK)
+			&& (Compression_Output_Length(&output) == length)
+			&& (memcmp(decoded, input, length) == 0);
+}
+
+static uint32_t Test_Lz4_Length(const uint8_t **at, uint32_t length)
+{
+	uint8_t value = 0;
+
+	do {
+		value = *(*at)++;
+		length += value;
+	} while(value == 255);
+	return length;
+}
+
+/**
+ * Walks the LZ4 sequences and checks the end of block rules of the format:
+ * every match starts 12 bytes before the end at the latest, and the last
+ * 5 bytes are literals (blocks under 13 bytes are literals only).
+ */
+static uint8_t Test_Lz4_Rules(uint32_t encodedLength, uint32_t length)
+{
+	const uint8_t *at = encoded;
+	const uint8_t *end = encoded + encodedLength;
+	uint32_t produced = 0;
+	uint32_t literalLength = 0;
+	uint32_t matchLength = 0;
+	uint32_t offset = 0;
+	uint8_t token = 0;
+
+	while(at < end) {
+		token = *at++;
+		literalLength = token >> 4;
+		if(literalLength == 15) {
+			literalLength = Test_Lz4_Length(&at, literalLength);
+		}
+		at += literalLength;
+		produced += literalLength;
+		if(at >= end) {
+			break;
+		}
+
+		offset = (uint32_t)at[0] | ((uint32_t)at[1] << 8);
+		at += 2;
+		matchLength = (token & 0x0F);
+		if(matchLength == 15) {
+			matchLength = Test_Lz4_Length(&at, matchLength);
+		}
+		matchLength += 4;
+
+		if((offset == 0) || (offset > produced) || ((produced + 12) > length)
+				|| ((produced + matchLength + 5) > length)) {
+			return 0;
+		}
+		produced += matchLength;
+	}
+	return (at == end) && (produced == length) && ((length < 13) || (literalLength >= 5));
+}
+
+/* Encodes and decodes the input over and over, prints the ratio and MB/s */
+static void Test_Report(const char *name, uint8_t encoding, uint32_t length)
+{
+	Compression_Output_t output;
+	uint32_t encodedLength = 0;
+	uint32_t rounds = 0;
+	double start = Test_Seconds();
+	double encodeTime = 0;
+	double decodeTime = 0;
+
+	do {
+		encodedLength = Compression_Encode(encoding, input, length, encoded, sizeof(encoded));
+		rounds++;
+		encodeTime = Test_Seconds() - start;
+	} while(encodeTime < TEST_BENCH_SECONDS);
+	encodeTime /= rounds;
+
+	rounds = 0;
+	start = Test_Seconds();
+	do {
+		Compression_Output_Init(&output, staging, sizeof(staging), decoded, length, Test_Sink);
+		Compression_Decode(&output, encoding, encoded, encodedLength);
+		Compression_Output_Finish(&output);
+		rounds++;
+		decodeTime = Test_Seconds() - start;
+	} while(decodeTime < TEST_BENCH_SECONDS);
+	decodeTime /= rounds;
+
+	printf("%-14s %s: %5lu -> %5lu bytes (%5.1f%%), encode %7.1f MB/s, decode %7.1f MB/s\n",
+			name, (encoding == COMPRESSION_RLE) ? "RLE" : "LZ4", (unsigned long)length,
+			(unsigned long)encodedLength, (100.0 * encodedLength) / length,
+			(length / encodeTime) * 1e-6, (length / decodeTime) * 1e-6);
+}
+
+/* Thumb like code: a small set of instruction words, literal pools, erased tail */
+static void Test_Firmware_Image(uint32_t length)
+{
+	static const uint16_t opcodes[] = { 0xB580, 0xAF00, 0x4B03, 0x681B, 0x2201, 0x601A, 0xBD80, 0xF000,
+			0xF8D3, 0x4618, 0x3708, 0x46BD, 0x2300, 0x60FB, 0xE7FE, 0x4770 };
+
+	srand(3);
+	for(uint32_t i = 0; i < length; i += 2) {
+		uint16_t halfword = opcodes[rand() % 16];
+		if((rand() % 16) == 0) {
+			halfword = (uint16_t)rand();								/* Literal pool / immediates */
+		}
+		input[i] = (uint8_t)halfword;
+		input[i + 1] = (uint8_t)(halfword >> 8);
+	}
+	memset(&input[(length * 7) / 8], 0xFF, length - ((length * 7) / 8));
+}
+
+/*---------------  Section: Tests --------------- */
+
+static void Test_Encode_Firmware(void)
+{
+	uint32_t encodedLength = 0;
+
+	Test_Firmware_Image(TEST_BLOCK_SIZE);
+
+	encodedLength = Compression_Encode(COMPRESSION_RLE, input, TEST_BLOCK_SIZE, encoded, sizeof(encoded));
+	TEST_CHECK((encodedLength != 0) && Test_Round_Trip(COMPRESSION_RLE, encodedLength, TEST_BLOCK_SIZE));
+	Test_Report("firmware", COMPRESSION_RLE, TEST_BLOCK_SIZE);
+
+	/* The largest LZ4 block, its last match near the 16 bit position limit */
+	encodedLength = Compression_Encode(COMPRESSION_LZ4, input, TEST_BLOCK_SIZE, encoded, sizeof(encoded));
+	TEST_CHECK(encodedLength != 0);
+	TEST_CHECK(Test_Lz4_Rules(encodedLength, TEST_BLOCK_SIZE));
+	TEST_CHECK(Test_Round_Trip(COMPRESSION_LZ4, encodedLength, TEST_BLOCK_SIZE));
+	Test_Report("firmware", COMPRESSION_LZ4, TEST_BLOCK_SIZE);
+
+	TEST_CHECK(Compression_Encode(COMPRESSION_LZ4, input, TEST_BLOCK_SIZE + 1, encoded, sizeof(encoded)) == 0);
+	TEST_CHECK(Compression_Encode(COMPRESSION_RAW, input, 64, encoded, sizeof(encoded)) == 0);
+}
+
+/* A block that doesn't shrink doesn't fit in length - 1 bytes, it goes raw */
+static void Test_Encode_Incompressible(void)
+{
+	uint32_t encodedLength = 0;
+
+	srand(5);
+	for(uint32_t i = 0; i < TEST_BLOCK_SIZE; ++i) {
+		input[i] = (uint8_t)rand();
+	}
+
+	TEST_CHECK(Compression_Encode(COMPRESSION_RLE, input, 4096, encoded, 4096 - 1) == 0);
+	TEST_CHECK(Compression_Encode(COMPRESSION_LZ4, input, 4096, encoded, 4096 - 1) == 0);
+	TEST_CHECK(Compression_Encode(COMPRESSION_LZ4, input, TEST_BLOCK_SIZE, encoded, TEST_BLOCK_SIZE - 1) == 0);
+
+	/* With room it still round trips, just larger than the input */
+	encodedLength = Compression_Encode(COMPRESSION_RLE, input, 4096, encoded, sizeof(encoded));
+	TEST_CHECK((encodedLength > 4096) && Test_Round_Trip(COMPRESSION_RLE, encodedLength, 4096));
+	encodedLength = Compression_Encode(COMPRESSION_LZ4, input, 4096, encoded, sizeof(encoded));
+	TEST_CHECK((encodedLength > 4096) && Test_Lz4_Rules(encodedLength, 4096)
+			&& Test_Round_Trip(COMPRESSION_LZ4, encodedLength, 4096));
+	Test_Report("incompressible", COMPRESSION_RLE, 4096);
+	Test_Report("incompressible", COMPRESSION_LZ4, 4096);
+}
+
+/* Runs longer than one control byte holds, split at exactly 128 */
+static void Test_Encode_Long_Runs(void)
+{
+	static const uint32_t runs[] = { 127, 128, 129, 256, 257, 1000 };
+	uint32_t encodedLength = 0;
+
+	for(uint32_t r = 0; r < (sizeof(runs) / sizeof(runs[0])); ++r) {
+		memset(input, 0xFF, runs[r]);
+		encodedLength = Compression_Encode(COMPRESSION_RLE, input, runs[r], encoded, sizeof(encoded));
+		TEST_CHECK(encodedLength == (2 * ((runs[r] + 127) / 128)));
+		TEST_CHECK((encoded[0] == (0x80 | (((runs[r] < 128) ? runs[r] : 128) - 1))) && (encoded[1] == 0xFF));
+		TEST_CHECK(Test_Round_Trip(COMPRESSION_RLE, encodedLength, runs[r]));
+	}
+
+	/* Runs between literal stretches longer than 128 */
+	for(uint32_t i = 0; i < 4096; ++i) {
+		input[i] = ((i % 1024) < 300) ? (uint8_t)(i * 7) : (uint8_t)(i / 1024);
+	}
+	encodedLength = Compression_Encode(COMPRESSION_RLE, input, 4096, encoded, sizeof(encoded));
+	TEST_CHECK((encodedLength != 0) && Test_Round_Trip(COMPRESSION_RLE, encodedLength, 4096));
+	encodedLength = Compression_Encode(COMPRESSION_LZ4, input, 4096, encoded, sizeof(encoded));
+	TEST_CHECK(Test_Lz4_Rules(encodedLength, 4096) && Test_Round_Trip(COMPRESSION_LZ4, encodedLength, 4096));
+	Test_Report("runs", COMPRESSION_RLE, 4096);
+	Test_Report("runs", COMPRESSION_LZ4, 4096);
+}
+
+/* Every short length around the LZ4 end of block limits */
+static void Test_Encode_Short(void)
+{
+	uint32_t encodedLength = 0;
+
+	memset(input, 0x11, 64);
+	for(uint32_t length = 1; length <= 64; ++length) {
+		encodedLength = Compression_Encode(COMPRESSION_LZ4, input, length, encoded, sizeof(encoded));
+		TEST_CHECK(Test_Lz4_Rules(encodedLength, length) && Test_Round_Trip(COMPRESSION_LZ4, encodedLength, length));
+		encodedLength = Compression_Encode(COMPRESSION_RLE, input, length, encoded, sizeof(encoded));
+		TEST_CHECK(Test_Round_Trip(COMPRESSION_RLE, encodedLength, length));
+	}
+}
+
+int main(void)
+{
+	Test_Encode_Firmware();
+	Test_Encode_Incompressible();
+	Test_Encode_Long_Runs();
+	Test_Encode_Short();
+
+	printf("test_compression_encode: %s\n", (failures == 0) ? "PASS" : "FAIL");
+	return (failures == 0) ? 0 : 1;
+}
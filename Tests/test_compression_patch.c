@@ -0,0 +1,212 @@
+/**
+ ******************************************************************************
+ * @file           : test_compression_patch.c
+ * @author         : Mostafa Asaad (https://github.com/M0stafa077)
+ * @brief          : Host test of the delta patch instructions over
+ *                   Compression_Decode(): COPY / INSERT decoding, every
+ *                   encoding, and the malformed patches the bootloader
+ *                   rejects with 'D'.
+ ******************************************************************************
+ */
+
+/*---------------  Section: Includes --------------- */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "compression/compression.h"
+
+/*---------------  Section: Macros Declarations --------------- */
+
+#define TEST_IMAGE_SIZE					8192U
+/* !< Small and odd sized against the image, so flushes land everywhere */
+#define TEST_STAGING_SIZE				64U
+
+#define TEST_CHECK(condition)			Test_Check((condition), #condition, __LINE__)
+
+/*---------------  Section: Global Variables --------------- */
+
+static uint8_t oldImage[TEST_IMAGE_SIZE];
+static uint8_t newImage[TEST_IMAGE_SIZE];
+static uint8_t expectedImage[TEST_IMAGE_SIZE];
+static uint8_t staging[TEST_STAGING_SIZE];
+static uint8_t patch[2 * TEST_IMAGE_SIZE];
+static uint32_t patchLength;
+static uint32_t expectedLength;
+static uint32_t failures;
+
+/*---------------  Section: Helper Functions --------------- */
+
+static void Test_Check(int condition, const char *text, int line)
+{
+	if(!condition) {
+		printf("FAIL line %d: %s\n", line, text);
+		failures++;
+	}
+}
+
+/* Flash stand-in: programs the flushed bytes where the decoder reads them back */
+static uint8_t Test_Sink(uint32_t offset, const uint8_t *data, uint32_t length)
+{
+	if((offset + length) > sizeof(newImage)) {
+		return 1;
+	}
+	memcpy(&newImage[offset], data, length);
+	return 0;
+}
+
+static void Test_Patch_Reset(void)
+{
+	patchLength = 0;
+	expectedLength = 0;
+}
+
+static void Test_Patch_Copy(uint32_t offset, uint32_t length)
+{
+	patch[patchLength++] = COMPRESSION_PATCH_COPY;
+	memcpy(&patch[patchLength], &offset, 4);
+	memcpy(&patch[patchLength + 4], &length, 4);
+	patchLength += 8;
+
+	memcpy(&expectedImage[expectedLength], &oldImage[offset], length);
+	expectedLength += length;
+}
+
+static void Test_Patch_Insert(uint8_t encoding, const uint8_t *data, uint32_t length)
+{
+	uint32_t encodedLength = length;
+	uint16_t field = 0;
+
+	if(encoding == COMPRESSION_RAW) {
+		memcpy(&patch[patchLength + 4], data, length);
+	}
+	else {
+		encodedLength = Compression_Encode(encoding, data, length, &patch[patchLength + 4],
+				sizeof(patch) - patchLength - 4);
+	}
+	field = (uint16_t)encodedLength;
+
+	TEST_CHECK((encodedLength != 0) && (encodedLength <= 0xFFFFU));
+	patch[patchLength] = COMPRESSION_PATCH_INSERT;
+	patch[patchLength + 1] = encoding;
+	memcpy(&patch[patchLength + 2], &field, 2);
+	patchLength += 4 + encodedLength;
+
+	memcpy(&expectedImage[expectedLength], data, length);
+	expectedLength += length;
+}
+
+static uint8_t Test_Apply(Compression_Output_t *output, const uint8_t *instructions, uint32_t length)
+{
+	Compression_Output_Init(output, staging, sizeof(staging), newImage, sizeof(newImage), Test_Sink);
+	memset(newImage, 0xFF, sizeof(newImage));
+	return Compression_Apply_Patch(output, oldImage, sizeof(oldImage), instructions, length);
+}
+
+/*---------------  Section: Tests --------------- */
+
+/* Every instruction and encoding, the patch split over several frames */
+static void Test_Patch_Decoding(void)
+{
+	Compression_Output_t output;
+	uint8_t inserted[600];
+	uint32_t split = 0;
+
+	for(uint32_t i = 0; i < sizeof(inserted); ++i) {
+		inserted[i] = (uint8_t)((i / 7) * 13);	/* Runs and repeats, every encoder gains */
+	}
+
+	Test_Patch_Reset();
+	Test_Patch_Copy(0, 1000);
+	Test_Patch_Insert(COMPRESSION_RAW, inserted, 37);
+	Test_Patch_Copy(1003, 1);
+	Test_Patch_Insert(COMPRESSION_RLE, inserted, sizeof(inserted));
+	Test_Patch_Copy(TEST_IMAGE_SIZE - 500, 500);
+	Test_Patch_Insert(COMPRESSION_LZ4, inserted, sizeof(inserted));
+	Test_Patch_Copy(4096, 0);
+	Test_Patch_Copy(17, 2048);
+	split = patchLength;
+	Test_Patch_Insert(COMPRESSION_LZ4, &inserted[100], 300);
+	Test_Patch_Copy(5000, 777);
+
+	/* One frame, then the same patch over two frames with END padding */
+	TEST_CHECK(Test_Apply(&output, patch, patchLength) == COMPRESSION_OK);
+	TEST_CHECK(Compression_Output_Finish(&output) == COMPRESSION_OK);
+	TEST_CHECK(Compression_Output_Length(&output) == expectedLength);
+	TEST_CHECK(memcmp(newImage, expectedImage, expectedLength) == 0);
+
+	memset(&patch[patchLength], COMPRESSION_PATCH_END, 16);
+	TEST_CHECK(Test_Apply(&output, patch, split) == COMPRESSION_OK);
+	TEST_CHECK(Compression_Apply_Patch(&output, oldImage, sizeof(oldImage),
+			&patch[split], patchLength - split + 16) == COMPRESSION_OK);
+	TEST_CHECK(Compression_Output_Finish(&output) == COMPRESSION_OK);
+	TEST_CHECK(Compression_Output_Length(&output) == expectedLength);
+	TEST_CHECK(memcmp(newImage, expectedImage, expectedLength) == 0);
+}
+
+/* Everything after END is padding, even bytes that look like instructions */
+static void Test_Patch_End(void)
+{
+	Compression_Output_t output;
+
+	Test_Patch_Reset();
+	Test_Patch_Copy(10, 20);
+	patch[patchLength] = COMPRESSION_PATCH_END;
+	patch[patchLength + 1] = 0x55;
+
+	TEST_CHECK(Test_Apply(&output, patch, patchLength + 2) == COMPRESSION_OK);
+	TEST_CHECK(Compression_Output_Length(&output) == 20);
+}
+
+static void Test_Patch_Malformed(void)
+{
+	Compression_Output_t output;
+	uint8_t data[8] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+
+	/* COPY past the end of the source, and one whose offset + length wraps */
+	Test_Patch_Reset();
+	Test_Patch_Copy(TEST_IMAGE_SIZE - 4, 4);
+	patch[5] = 5;
+	TEST_CHECK(Test_Apply(&output, patch, patchLength) == COMPRESSION_CORRUPT);
+	memcpy(&patch[1], &(uint32_t){ 16 }, 4);
+	memcpy(&patch[5], &(uint32_t){ 0xFFFFFFF8UL }, 4);
+	TEST_CHECK(Test_Apply(&output, patch, patchLength) == COMPRESSION_CORRUPT);
+
+	/* Instructions cut short */
+	Test_Patch_Reset();
+	Test_Patch_Copy(0, 4);
+	TEST_CHECK(Test_Apply(&output, patch, patchLength - 1) == COMPRESSION_CORRUPT);
+	Test_Patch_Reset();
+	Test_Patch_Insert(COMPRESSION_RAW, data, sizeof(data));
+	TEST_CHECK(Test_Apply(&output, patch, patchLength - 1) == COMPRESSION_CORRUPT);
+	TEST_CHECK(Test_Apply(&output, patch, 3) == COMPRESSION_CORRUPT);
+
+	/* Unknown instruction and unknown encoding */
+	patch[0] = 0x03;
+	TEST_CHECK(Test_Apply(&output, patch, patchLength) == COMPRESSION_CORRUPT);
+	patch[0] = COMPRESSION_PATCH_INSERT;
+	patch[1] = 0x7F;
+	TEST_CHECK(Test_Apply(&output, patch, patchLength) == COMPRESSION_CORRUPT);
+
+	/* Output longer than the staging sector allows */
+	Test_Patch_Reset();
+	Test_Patch_Copy(0, 4096);
+	Compression_Output_Init(&output, staging, sizeof(staging), newImage, 4095, Test_Sink);
+	TEST_CHECK(Compression_Apply_Patch(&output, oldImage, sizeof(oldImage), patch, patchLength)
+			== COMPRESSION_OVERFLOW);
+}
+
+int main(void)
+{
+	srand(1);
+	for(uint32_t i = 0; i < sizeof(oldImage); ++i) {
+		oldImage[i] = (uint8_t)rand();
+	}
+
+	Test_Patch_Decoding();
+	Test_Patch_End();
+	Test_Patch_Malformed();
+
+	printf("test_compression_patch: %s\n", (failures == 0) ? "PASS" : "FAIL");
+	return (failures == 0) ? 0 : 1;
+}
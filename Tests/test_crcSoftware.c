@@ -0,0 +1,126 @@
+/**
+ ******************************************************************************
+ * @file           : test_crcSoftware.c
+ * @author         : Mostafa Asaad (https://github.com/M0stafa077)
+ * @brief          : Host equivalence test of the software CRC kernels:
+ *                   every kernel against the bitwise reference, on random
+ *                   word and byte buffers of every length up to
+ *                   TEST_MAX_LENGTH, whole and split in two calls.
+ ******************************************************************************
+ */
+
+/*---------------  Section: Includes --------------- */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "crcServices/crcSoftware.h"
+
+/*---------------  Section: Macros Declarations --------------- */
+
+#define TEST_MAX_LENGTH					300U
+#define TEST_ROUNDS						8U
+
+#define TEST_CHECK(condition)			Test_Check((condition), #condition, __LINE__)
+
+/*---------------  Section: Types Declarations --------------- */
+
+typedef uint32_t (* Test_Words_Kernel_t) (uint32_t crc, const uint32_t *words, uint32_t wordCount);
+typedef uint32_t (* Test_Bytes_Kernel_t) (uint32_t crc, const uint8_t *bytes, uint32_t length);
+
+/*---------------  Section: Global Variables --------------- */
+
+static const Test_Words_Kernel_t wordKernels[] = {
+	Crc_Table_Words, Crc_Slice4_Words, Crc_Slice8_Words
+};
+static const Test_Bytes_Kernel_t byteKernels[] = {
+	Crc_Table_Bytes, Crc_Slice4_Bytes
+};
+
+/* !< One extra element, so the buffers also start unaligned to 8 bytes */
+static uint32_t words[TEST_MAX_LENGTH + 1];
+static uint8_t bytes[TEST_MAX_LENGTH + 1];
+static uint32_t failures;
+
+/*---------------  Section: Helper Functions --------------- */
+
+static void Test_Check(int condition, const char *text, int line)
+{
+	if(!condition) {
+		printf("FAIL line %d: %s\n", line, text);
+		failures++;
+	}
+}
+
+/*---------------  Section: Tests --------------- */
+
+/* The CRC unit result for one word, from the reference manual */
+static void Test_Known_Vector(void)
+{
+	const uint32_t word = 0x12345678UL;
+	const uint8_t wordBytes[4] = { 0x12, 0x34, 0x56, 0x78 };
+
+	TEST_CHECK(Crc_Bitwise_Words(CRC_SOFTWARE_INIT, &word, 1) == 0xDF8A8A2BUL);
+	for(uint32_t kernel = 0; kernel < (sizeof(wordKernels) / sizeof(wordKernels[0])); ++kernel) {
+		TEST_CHECK(wordKernels[kernel](CRC_SOFTWARE_INIT, &word, 1) == 0xDF8A8A2BUL);
+	}
+	/* Bytes are zero extended words, one byte per step */
+	TEST_CHECK(Crc_Bitwise_Bytes(CRC_SOFTWARE_INIT, wordBytes, 4)
+			== Crc_Bitwise_Words(Crc_Bitwise_Words(Crc_Bitwise_Words(Crc_Bitwise_Words(CRC_SOFTWARE_INIT,
+					&(uint32_t){ 0x12 }, 1), &(uint32_t){ 0x34 }, 1), &(uint32_t){ 0x56 }, 1), &(uint32_t){ 0x78 }, 1));
+}
+
+static void Test_Words_Equivalence(void)
+{
+	for(uint32_t round = 0; round < TEST_ROUNDS; ++round) {
+		for(uint32_t i = 0; i < (TEST_MAX_LENGTH + 1); ++i) {
+			words[i] = ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+		}
+		for(uint32_t start = 0; start < 2; ++start) {
+			for(uint32_t length = 0; length <= TEST_MAX_LENGTH; ++length) {
+				uint32_t seed = (round == 0) ? CRC_SOFTWARE_INIT : words[0];
+				uint32_t reference = Crc_Bitwise_Words(seed, &words[start], length);
+				uint32_t split = length / 3;
+
+				for(uint32_t kernel = 0; kernel < (sizeof(wordKernels) / sizeof(wordKernels[0])); ++kernel) {
+					TEST_CHECK(wordKernels[kernel](seed, &words[start], length) == reference);
+					TEST_CHECK(wordKernels[kernel](wordKernels[kernel](seed, &words[start], split),
+							&words[start + split], length - split) == reference);
+				}
+			}
+		}
+	}
+}
+
+static void Test_Bytes_Equivalence(void)
+{
+	for(uint32_t round = 0; round < TEST_ROUNDS; ++round) {
+		for(uint32_t i = 0; i < (TEST_MAX_LENGTH + 1); ++i) {
+			bytes[i] = (uint8_t)rand();
+		}
+		for(uint32_t start = 0; start < 2; ++start) {
+			for(uint32_t length = 0; length <= TEST_MAX_LENGTH; ++length) {
+				uint32_t seed = (round == 0) ? CRC_SOFTWARE_INIT : (uint32_t)rand();
+				uint32_t reference = Crc_Bitwise_Bytes(seed, &bytes[start], length);
+				uint32_t split = length / 3;
+
+				for(uint32_t kernel = 0; kernel < (sizeof(byteKernels) / sizeof(byteKernels[0])); ++kernel) {
+					TEST_CHECK(byteKernels[kernel](seed, &bytes[start], length) == reference);
+					TEST_CHECK(byteKernels[kernel](byteKernels[kernel](seed, &bytes[start], split),
+							&bytes[start + split], length - split) == reference);
+				}
+			}
+		}
+	}
+}
+
+int main(void)
+{
+	srand(1);
+
+	Test_Known_Vector();
+	Test_Words_Equivalence();
+	Test_Bytes_Equivalence();
+
+	printf("test_crcSoftware: %s\n", (failures == 0) ? "PASS" : "FAIL");
+	return (failures == 0) ? 0 : 1;
+}
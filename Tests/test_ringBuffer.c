@@ -0,0 +1,180 @@
+/**
+ ******************************************************************************
+ * @file           : test_ringBuffer.c
+ * @author         : Mostafa Asaad (https://github.com/M0stafa077)
+ * @brief          : Host test of the receive ring against a mocked UART:
+ *                   a circular DMA writing the storage and reporting its
+ *                   position on the half transfer, transfer complete and
+ *                   IDLE events, as hostLink.c does on the target.
+ ******************************************************************************
+ */
+
+/*---------------  Section: Includes --------------- */
+
+#include <stdio.h>
+#include <string.h>
+#include "ringBuffer/ringBuffer.h"
+
+/*---------------  Section: Macros Declarations --------------- */
+
+#define TEST_RING_SIZE					64U
+
+#define TEST_CHECK(condition)			Test_Check((condition), #condition, __LINE__)
+
+/*---------------  Section: Global Variables --------------- */
+
+static uint8_t storage[TEST_RING_SIZE];
+static RingBuffer_t ring;
+/* !< Mocked DMA: next position written, and the next byte value sent */
+static uint32_t dmaPosition;
+static uint8_t nextByte;
+/* !< Next byte value the consumer expects */
+static uint8_t expectedByte;
+static uint32_t failures;
+
+/*---------------  Section: Helper Functions --------------- */
+
+static void Test_Check(int condition, const char *text, int line)
+{
+	if(!condition) {
+		printf("FAIL line %d: %s\n", line, text);
+		failures++;
+	}
+}
+
+static void Test_Reset(void)
+{
+	memset(storage, 0, sizeof(storage));
+	RingBuffer_Init(&ring, storage, sizeof(storage));
+	dmaPosition = 0;
+	nextByte = 0;
+	expectedByte = 0;
+}
+
+/* The UART receives bytes: the DMA stores them, the half transfer and
+ * transfer complete events report on their way, the IDLE event at the end */
+static void Mock_Uart_Receive(uint32_t length, uint8_t idleEvent)
+{
+	for(uint32_t i = 0; i < length; ++i) {
+		storage[dmaPosition] = nextByte++;
+		dmaPosition++;
+		if(dmaPosition == (TEST_RING_SIZE / 2)) {
+			RingBuffer_Produce(&ring, dmaPosition);
+		}
+		else if(dmaPosition == TEST_RING_SIZE) {
+			RingBuffer_Produce(&ring, dmaPosition);
+			dmaPosition = 0;
+		}
+	}
+	if(idleEvent) {
+		RingBuffer_Produce(&ring, dmaPosition);
+	}
+}
+
+/* Reads and checks the byte sequence, returns the bytes read */
+static uint32_t Test_Read(uint32_t length)
+{
+	uint8_t data[TEST_RING_SIZE];
+	uint32_t read = RingBuffer_Read(&ring, data, length);
+
+	for(uint32_t i = 0; i < read; ++i) {
+		TEST_CHECK(data[i] == expectedByte);
+		expectedByte++;
+	}
+	return read;
+}
+
+/*---------------  Section: Tests --------------- */
+
+/* Many laps in frames of every size, each read right after its IDLE */
+static void Test_Wrap_Around(void)
+{
+	Test_Reset();
+	for(uint32_t length = 1; length <= TEST_RING_SIZE; ++length) {
+		Mock_Uart_Receive(length, 1);
+		TEST_CHECK(RingBuffer_Count(&ring) == length);
+		TEST_CHECK(Test_Read(length) == length);
+		TEST_CHECK(RingBuffer_Count(&ring) == 0);
+	}
+	TEST_CHECK(RingBuffer_Take_Overrun(&ring) == RING_BUFFER_OK);
+
+	/* A full lap with no event but the transfer complete one */
+	Test_Reset();
+	Mock_Uart_Receive(TEST_RING_SIZE / 2, 0);
+	TEST_CHECK(Test_Read(TEST_RING_SIZE) == (TEST_RING_SIZE / 2));
+	Mock_Uart_Receive(TEST_RING_SIZE / 2, 0);
+	TEST_CHECK(RingBuffer_Count(&ring) == (TEST_RING_SIZE / 2));
+	Mock_Uart_Receive(TEST_RING_SIZE / 2, 0);
+	TEST_CHECK(RingBuffer_Count(&ring) == TEST_RING_SIZE);
+	TEST_CHECK(RingBuffer_Take_Overrun(&ring) == RING_BUFFER_OK);
+	TEST_CHECK(Test_Read(TEST_RING_SIZE) == TEST_RING_SIZE);
+}
+
+/* Reads and peeks over the end of the storage */
+static void Test_Straddling_Read(void)
+{
+	Test_Reset();
+	Mock_Uart_Receive(TEST_RING_SIZE - 5, 1);
+	TEST_CHECK(Test_Read(TEST_RING_SIZE - 5) == (TEST_RING_SIZE - 5));
+
+	Mock_Uart_Receive(20, 1);
+	for(uint32_t offset = 0; offset < 20; ++offset) {
+		TEST_CHECK(RingBuffer_Peek(&ring, offset) == (uint8_t)(expectedByte + offset));
+	}
+	TEST_CHECK(Test_Read(3) == 3);
+	TEST_CHECK(Test_Read(10) == 10);	/* The 2 last bytes, then 8 wrapped ones */
+	TEST_CHECK(Test_Read(TEST_RING_SIZE) == 7);
+	TEST_CHECK(Test_Read(1) == 0);
+}
+
+static void Test_Overrun(void)
+{
+	Test_Reset();
+	Mock_Uart_Receive(10, 1);
+	TEST_CHECK(Test_Read(4) == 4);
+
+	/* The producer laps the consumer: only the latest lap is kept */
+	Mock_Uart_Receive(TEST_RING_SIZE, 1);
+	TEST_CHECK(RingBuffer_Count(&ring) == TEST_RING_SIZE);
+	TEST_CHECK(RingBuffer_Take_Overrun(&ring) == RING_BUFFER_OVERRUN);
+	TEST_CHECK(RingBuffer_Take_Overrun(&ring) == RING_BUFFER_OK);
+
+	expectedByte = (uint8_t)(nextByte - TEST_RING_SIZE);
+	TEST_CHECK(Test_Read(TEST_RING_SIZE) == TEST_RING_SIZE);
+
+	/* Reception goes on normally */
+	Mock_Uart_Receive(9, 1);
+	TEST_CHECK(Test_Read(9) == 9);
+	TEST_CHECK(RingBuffer_Take_Overrun(&ring) == RING_BUFFER_OK);
+}
+
+static void Test_Discard(void)
+{
+	Test_Reset();
+	Mock_Uart_Receive(TEST_RING_SIZE - 2, 1);
+	TEST_CHECK(Test_Read(TEST_RING_SIZE - 6) == (TEST_RING_SIZE - 6));
+	Mock_Uart_Receive(10, 1);
+
+	/* Over the end of the storage, then more than pending */
+	RingBuffer_Discard(&ring, 7);
+	expectedByte += 7;
+	TEST_CHECK(RingBuffer_Count(&ring) == 7);
+	TEST_CHECK(RingBuffer_Peek(&ring, 0) == expectedByte);
+	RingBuffer_Discard(&ring, 100);
+	TEST_CHECK(RingBuffer_Count(&ring) == 0);
+
+	expectedByte = nextByte;
+	Mock_Uart_Receive(5, 1);
+	TEST_CHECK(Test_Read(5) == 5);
+}
+
+int main(void)
+{
+	Test_Wrap_Around();
+	Test_Straddling_Read();
+	Test_Overrun();
+	Test_Discard();
+
+	printf("test_ringBuffer: %s\n", (failures == 0) ? "PASS" : "FAIL");
+	return (failures == 0) ? 0 : 1;
+}
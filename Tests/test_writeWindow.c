@@ -0,0 +1,363 @@
+/**
+ ******************************************************************************
+ * @file           : test_writeWindow.c
+ * @author         : Mostafa Asaad (https://github.com/M0stafa077)
+ * @brief          : Host test of the pipelined write bookkeeping, then a
+ *                   simulated image transfer comparing the window sizes,
+ *                   stop and wait (window 1) included.
+ *
+ *                   The simulation model, per write frame:
+ *                   - the wire: header, 4 KB of data and CRC at 10 bits a byte,
+ *                   - the host adapter latency, each way,
+ *                   - programming 1024 words at the typical 16 us each,
+ *                   - the device receives through its DMA while it programs,
+ *                   - damaged frames are dropped and NACKed once a later
+ *                     frame shows the gap, or resent when the oldest frame
+ *                     in flight times out. Every window size sees the same
+ *                     damaged transmissions.
+ *                   Frames are assumed to leave the receive ring for a frame
+ *                   slot as they complete, the ring itself is not modelled.
+ ******************************************************************************
+ */
+
+/*---------------  Section: Includes --------------- */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "writeWindow/writeWindow.h"
+
+/*---------------  Section: Macros Declarations --------------- */
+
+#define TEST_CHECK(condition)			Test_Check((condition), #condition, __LINE__)
+
+/* !< Simulated transfer: a 224 KB application in 4 KB write frames */
+#define SIM_FRAME_DATA_SIZE				4096U
+#define SIM_FRAME_OVERHEAD				16U		/* !< v2 header, sequence, address and CRC */
+#define SIM_FRAME_COUNT					56U
+#define SIM_REPLY_SIZE					4U
+#define SIM_PROGRAM_TIME_S				((SIM_FRAME_DATA_SIZE / 4) * 16e-6)
+#define SIM_LATENCY_S					1e-3	/* !< Host adapter latency, each way */
+#define SIM_TIMEOUT_S					0.5
+#define SIM_MAX_EVENTS					256U
+
+/*---------------  Section: Types Declarations --------------- */
+
+typedef enum
+{
+	SIM_FRAME_ARRIVES,
+	SIM_ACK_ARRIVES,
+	SIM_NACK_ARRIVES,
+	SIM_TIMEOUT
+} Sim_Event_Type_t;
+
+typedef struct
+{
+	double time;
+	Sim_Event_Type_t type;
+	uint32_t frame;				/* !< Frame index, the wire carries its low 16 bits */
+	double sentAt;				/* !< SIM_TIMEOUT: the transmission it guards */
+	uint8_t damaged;
+} Sim_Event_t;
+
+typedef struct
+{
+	double baudRate;
+	uint32_t window;
+	double lossRate;
+	/* Host */
+	double wireFree;
+	uint32_t acked;				/* !< Frames below this one are acknowledged */
+	uint32_t nextFrame;
+	double lastSent[SIM_FRAME_COUNT];
+	uint32_t sendCount[SIM_FRAME_COUNT];
+	uint32_t resend[SIM_FRAME_COUNT];
+	uint32_t resendCount;
+	/* Device */
+	WriteWindow_t device;
+	double deviceFree;
+	/* Events */
+	Sim_Event_t events[SIM_MAX_EVENTS];
+	uint32_t eventCount;
+	double now;
+	uint32_t framesSent;
+} Sim_t;
+
+/*---------------  Section: Global Variables --------------- */
+
+static uint32_t failures;
+
+/*---------------  Section: Helper Functions --------------- */
+
+static void Test_Check(int condition, const char *text, int line)
+{
+	if(!condition) {
+		printf("FAIL line %d: %s\n", line, text);
+		failures++;
+	}
+}
+
+/*---------------  Section: Bookkeeping Tests --------------- */
+
+static void Test_Init(void)
+{
+	WriteWindow_t window;
+
+	TEST_CHECK(WriteWindow_Init(&window, 0) == 1);
+	TEST_CHECK(WriteWindow_Init(&window, 1000) == WRITE_WINDOW_MAX_SIZE);
+	TEST_CHECK(WriteWindow_Init(&window, 8) == 8);
+	TEST_CHECK((window.baseSequence == 0) && (window.receivedMask == 0) && (window.nackedMask == 0));
+}
+
+static void Test_In_Order(void)
+{
+	WriteWindow_t window;
+
+	WriteWindow_Init(&window, 4);
+	for(uint16_t sequence = 0; sequence < 100; ++sequence) {
+		TEST_CHECK(WriteWindow_Classify(&window, sequence) == WRITE_WINDOW_NEW);
+		TEST_CHECK(WriteWindow_Receive(&window, sequence) == 0);
+		TEST_CHECK(window.baseSequence == (uint16_t)(sequence + 1));
+		TEST_CHECK(WriteWindow_Classify(&window, sequence) == WRITE_WINDOW_DUPLICATE);
+	}
+	/* Beyond the window */
+	TEST_CHECK(WriteWindow_Classify(&window, 103) == WRITE_WINDOW_NEW);
+	TEST_CHECK(WriteWindow_Classify(&window, 104) == WRITE_WINDOW_DUPLICATE);
+}
+
+/* Gaps are NACKed once, the window slides when they are filled */
+static void Test_Gaps(void)
+{
+	WriteWindow_t window;
+
+	WriteWindow_Init(&window, 8);
+	TEST_CHECK(WriteWindow_Receive(&window, 2) == 0x3);
+	TEST_CHECK(window.baseSequence == 0);
+	TEST_CHECK(WriteWindow_Receive(&window, 5) == 0x18);
+	TEST_CHECK(WriteWindow_Classify(&window, 2) == WRITE_WINDOW_DUPLICATE);
+	TEST_CHECK(WriteWindow_Classify(&window, 3) == WRITE_WINDOW_NEW);
+
+	TEST_CHECK(WriteWindow_Receive(&window, 1) == 0);
+	TEST_CHECK(window.baseSequence == 0);
+	TEST_CHECK(WriteWindow_Receive(&window, 0) == 0);
+	TEST_CHECK(window.baseSequence == 3);
+	/* 3 and 4 stay NACKed once after the slide */
+	TEST_CHECK(WriteWindow_Receive(&window, 7) == 0x8);
+	TEST_CHECK(WriteWindow_Receive(&window, 4) == 0);
+	TEST_CHECK(WriteWindow_Receive(&window, 3) == 0);
+	TEST_CHECK(window.baseSequence == 6);
+	TEST_CHECK(WriteWindow_Receive(&window, 6) == 0);
+	TEST_CHECK(window.baseSequence == 8);
+	TEST_CHECK((window.receivedMask == 0) && (window.nackedMask == 0));
+}
+
+/* The 16 bit sequence numbers wrap inside a window */
+static void Test_Sequence_Wrap(void)
+{
+	WriteWindow_t window;
+
+	WriteWindow_Init(&window, WRITE_WINDOW_MAX_SIZE);
+	window.baseSequence = 0xFFFE;
+	TEST_CHECK(WriteWindow_Classify(&window, 0xFFFD) == WRITE_WINDOW_DUPLICATE);
+	TEST_CHECK(WriteWindow_Classify(&window, 0x001D) == WRITE_WINDOW_NEW);
+	TEST_CHECK(WriteWindow_Classify(&window, 0x001E) == WRITE_WINDOW_DUPLICATE);
+
+	TEST_CHECK(WriteWindow_Receive(&window, 0x0001) == 0x7);
+	TEST_CHECK(WriteWindow_Receive(&window, 0xFFFF) == 0);
+	TEST_CHECK(WriteWindow_Receive(&window, 0x0000) == 0);
+	TEST_CHECK(window.baseSequence == 0xFFFE);
+	TEST_CHECK(WriteWindow_Receive(&window, 0xFFFE) == 0);
+	TEST_CHECK(window.baseSequence == 0x0002);
+
+	/* The top bit of the bitmap */
+	TEST_CHECK(WriteWindow_Receive(&window, 0x0021) == 0x7FFFFFFFUL);
+	TEST_CHECK(window.receivedMask == 0x80000000UL);
+}
+
+/*---------------  Section: Transfer Simulation --------------- */
+
+static void Sim_Schedule(Sim_t *sim, Sim_Event_t event)
+{
+	if(sim->eventCount < SIM_MAX_EVENTS) {
+		sim->events[sim->eventCount++] = event;
+	}
+	else {
+		printf("FAIL simulation event queue full\n");
+		failures++;
+	}
+}
+
+static double Sim_Wire_Time(const Sim_t *sim, uint32_t bytes)
+{
+	return (bytes * 10.0) / sim->baudRate;
+}
+
+static void Sim_Send(Sim_t *sim, uint32_t frame)
+{
+	double start = (sim->now > sim->wireFree) ? sim->now : sim->wireFree;
+	double end = start + Sim_Wire_Time(sim, SIM_FRAME_DATA_SIZE + SIM_FRAME_OVERHEAD);
+	Sim_Event_t arrival = { end + SIM_LATENCY_S, SIM_FRAME_ARRIVES, frame, 0, 0 };
+	Sim_Event_t timeout = { end + SIM_TIMEOUT_S, SIM_TIMEOUT, frame, start, 0 };
+
+	/* The same transmission is damaged or not whatever the window */
+	srand((frame * 7919U) + sim->sendCount[frame]++);
+	arrival.damaged = ((double)rand() / RAND_MAX) < sim->lossRate;
+	sim->wireFree = end;
+	sim->lastSent[frame] = start;
+	sim->framesSent++;
+	Sim_Schedule(sim, arrival);
+	Sim_Schedule(sim, timeout);
+}
+
+/* Resends first, then new frames while the window allows */
+static void Sim_Host_Send(Sim_t *sim)
+{
+	while(sim->resendCount > 0) {
+		Sim_Send(sim, sim->resend[--sim->resendCount]);
+	}
+	while((sim->nextFrame < SIM_FRAME_COUNT) && (sim->nextFrame < (sim->acked + sim->window))) {
+		Sim_Send(sim, sim->nextFrame++);
+	}
+}
+
+static void Sim_Queue_Resend(Sim_t *sim, uint32_t frame)
+{
+	for(uint32_t i = 0; i < sim->resendCount; ++i) {
+		if(sim->resend[i] == frame) {
+			return;
+		}
+	}
+	sim->resend[sim->resendCount++] = frame;
+}
+
+/* The 16 bit sequence number back to a frame index near the host progress */
+static uint32_t Sim_Frame_Of(const Sim_t *sim, uint16_t sequence)
+{
+	return sim->acked + (uint16_t)(sequence - (uint16_t)sim->acked);
+}
+
+static void Sim_Device_Receive(Sim_t *sim, const Sim_Event_t *event)
+{
+	uint16_t sequence = (uint16_t)event->frame;
+	double start = (sim->now > sim->deviceFree) ? sim->now : sim->deviceFree;
+	double reply = 0;
+	uint32_t gaps = 0;
+	uint16_t base = 0;
+
+	if(event->damaged) {
+		return;		/* CRC mismatch, dropped silently */
+	}
+	if(WriteWindow_Classify(&sim->device, sequence) == WRITE_WINDOW_NEW) {
+		start += SIM_PROGRAM_TIME_S;
+		base = sim->device.baseSequence;
+		gaps = WriteWindow_Receive(&sim->device, sequence);
+	}
+	sim->deviceFree = start;
+	reply = start + Sim_Wire_Time(sim, SIM_REPLY_SIZE) + SIM_LATENCY_S;
+
+	for(uint16_t i = 0; gaps != 0; ++i, gaps >>= 1) {
+		if(gaps & 1UL) {
+			Sim_Event_t nack = { reply, SIM_NACK_ARRIVES, (uint16_t)(base + i), 0, 0 };
+			Sim_Schedule(sim, nack);
+		}
+	}
+	Sim_Event_t ack = { reply, SIM_ACK_ARRIVES, sim->device.baseSequence, 0, 0 };
+	Sim_Schedule(sim, ack);
+}
+
+/* Runs one transfer, returns its duration in seconds */
+static double Sim_Run(double baudRate, uint32_t window, double lossRate)
+{
+	static Sim_t sim;
+	uint32_t first = 0;
+
+	sim = (Sim_t){ .baudRate = baudRate, .window = window, .lossRate = lossRate };
+	WriteWindow_Init(&sim.device, window);
+	Sim_Host_Send(&sim);
+
+	while((sim.acked < SIM_FRAME_COUNT) && (sim.eventCount > 0)) {
+		first = 0;
+		for(uint32_t i = 1; i < sim.eventCount; ++i) {
+			if(sim.events[i].time < sim.events[first].time) {
+				first = i;
+			}
+		}
+		Sim_Event_t event = sim.events[first];
+		sim.events[first] = sim.events[--sim.eventCount];
+		sim.now = event.time;
+
+		switch(event.type) {
+			case SIM_FRAME_ARRIVES:
+				Sim_Device_Receive(&sim, &event);
+				break;
+			case SIM_ACK_ARRIVES:
+				if(Sim_Frame_Of(&sim, (uint16_t)event.frame) > sim.acked) {
+					sim.acked = Sim_Frame_Of(&sim, (uint16_t)event.frame);
+				}
+				Sim_Host_Send(&sim);
+				break;
+			case SIM_NACK_ARRIVES:
+				if(Sim_Frame_Of(&sim, (uint16_t)event.frame) < sim.nextFrame) {
+					Sim_Queue_Resend(&sim, Sim_Frame_Of(&sim, (uint16_t)event.frame));
+				}
+				Sim_Host_Send(&sim);
+				break;
+			case SIM_TIMEOUT:
+				if((event.frame == sim.acked) && (sim.lastSent[event.frame] == event.sentAt)) {
+					Sim_Queue_Resend(&sim, event.frame);
+					Sim_Host_Send(&sim);
+				}
+				break;
+		}
+	}
+
+	TEST_CHECK(sim.acked == SIM_FRAME_COUNT);
+	return sim.now;
+}
+
+static void Sim_Compare_Windows(void)
+{
+	const double baudRates[] = { 115200, 921600, 3000000 };
+	const double lossRates[] = { 0, 0.02 };
+	const uint32_t windows[] = { 1, 2, 4, 8, 32 };
+	double duration = 0;
+	double stopAndWait = 0;
+
+	printf("Simulated %u KB transfer, throughput in KB/s (speedup over stop and wait)\n",
+			(SIM_FRAME_COUNT * SIM_FRAME_DATA_SIZE) / 1024);
+	printf("%9s %6s", "baud", "loss");
+	for(uint32_t w = 0; w < (sizeof(windows) / sizeof(windows[0])); ++w) {
+		printf("   window %-6u", windows[w]);
+	}
+	printf("\n");
+
+	for(uint32_t b = 0; b < (sizeof(baudRates) / sizeof(baudRates[0])); ++b) {
+		for(uint32_t l = 0; l < (sizeof(lossRates) / sizeof(lossRates[0])); ++l) {
+			printf("%9.0f %5.0f%%", baudRates[b], lossRates[l] * 100);
+			for(uint32_t w = 0; w < (sizeof(windows) / sizeof(windows[0])); ++w) {
+				duration = Sim_Run(baudRates[b], windows[w], lossRates[l]);
+				if(w == 0) {
+					stopAndWait = duration;
+				}
+				else if(lossRates[l] == 0) {
+					/* Without losses a window never loses against stop and wait */
+					TEST_CHECK(duration <= stopAndWait);
+				}
+				printf("   %6.1f (%.2fx)",
+						(SIM_FRAME_COUNT * SIM_FRAME_DATA_SIZE) / 1024.0 / duration, stopAndWait / duration);
+			}
+			printf("\n");
+		}
+	}
+}
+
+int main(void)
+{
+	Test_Init();
+	Test_In_Order();
+	Test_Gaps();
+	Test_Sequence_Wrap();
+	Sim_Compare_Windows();
+
+	printf("test_writeWindow: %s\n", (failures == 0) ? "PASS" : "FAIL");
+	return (failures == 0) ? 0 : 1;
+}